@@ -22,6 +22,13 @@
 extern "C" {
 #endif
 
+typedef struct __JavaScriptContext* JavaScriptContextRef;
+
+/* A context evaluates the script once and can then be run on any number of trees from the same thread */
+JavaScriptContextRef JavaScriptContextCreate(NSString* script); //Returns NULL if the script fails to evaluate
+BOOL JavaScriptContextRunOnRootNode(JavaScriptContextRef context, ParserNode* root);
+void JavaScriptContextRelease(JavaScriptContextRef context);
+
 BOOL RunJavaScriptOnRootNode(NSString* script, ParserNode* root);
 
 #ifdef __cplusplus
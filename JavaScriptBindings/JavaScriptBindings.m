@@ -117,60 +117,102 @@ static ParserNode* _ResetNodeFunctionApplier(ParserNode* node, void* context) {
     return node;
 }
 
-BOOL RunJavaScriptOnRootNode(NSString* script, ParserNode* root) {
-    BOOL success = NO;
+struct __JavaScriptContext {
+    JSGlobalContextRef context;
+    JSObjectRef function;
+};
+
+/* The Node class and the type constants are rebuilt for each context, so a context must only be used on one thread at a time */
+JavaScriptContextRef JavaScriptContextCreate(NSString* script) {
+    JavaScriptContextRef context = NULL;
     NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
-    if(script.length && root) {
-        JSGlobalContextRef context = JSGlobalContextCreate(NULL);
-        if(context) {
+    if(script.length) {
+        JSGlobalContextRef jsContext = JSGlobalContextCreate(NULL);
+        if(jsContext) {
             JSStringRef jsScript = JSStringCreateWithCFString((CFStringRef)[NSString stringWithFormat:_wrapperScript, script]);
             if(jsScript) {
                 JSStringRef jsString;
                 
                 jsString = JSStringCreateWithCFString(CFSTR("Log"));
-                JSObjectSetProperty(context, JSContextGetGlobalObject(context), jsString, JSObjectMakeFunctionWithCallback(context, NULL, _LogFunction), kJSPropertyAttributeReadOnly | kJSPropertyAttributeDontDelete, NULL);
+                JSObjectSetProperty(jsContext, JSContextGetGlobalObject(jsContext), jsString, JSObjectMakeFunctionWithCallback(jsContext, NULL, _LogFunction), kJSPropertyAttributeReadOnly | kJSPropertyAttributeDontDelete, NULL);
                 JSStringRelease(jsString);
                 
-                JSObjectRef jsNode = JSObjectMakeConstructor(context, _GetParserNodeJavaScriptClass(), _CallAsConstructorCallback);
+                JSObjectRef jsNode = JSObjectMakeConstructor(jsContext, _GetParserNodeJavaScriptClass(), _CallAsConstructorCallback);
                 jsString = JSStringCreateWithCFString(CFSTR("Node"));
-                JSObjectSetProperty(context, JSContextGetGlobalObject(context), jsString, jsNode, kJSPropertyAttributeReadOnly | kJSPropertyAttributeDontDelete, NULL);
+                JSObjectSetProperty(jsContext, JSContextGetGlobalObject(jsContext), jsString, jsNode, kJSPropertyAttributeReadOnly | kJSPropertyAttributeDontDelete, NULL);
                 JSStringRelease(jsString);
                 
                 for(ParserLanguage* language in [ParserLanguage allLanguages]) {
                     for(Class nodeClass in language.nodeClasses) {
                         jsString = JSStringCreateWithCFString((CFStringRef)[NSString stringWithFormat:@"TYPE_%@", [[nodeClass name] uppercaseString]]);
-                        JSObjectSetProperty(context, jsNode, jsString, JSValueMakeNumber(context, (double)(long)nodeClass), kJSPropertyAttributeReadOnly | kJSPropertyAttributeDontDelete, NULL);
+                        JSObjectSetProperty(jsContext, jsNode, jsString, JSValueMakeNumber(jsContext, _KindOfClass(nodeClass)), kJSPropertyAttributeReadOnly | kJSPropertyAttributeDontDelete, NULL);
                         JSStringRelease(jsString);
                     }
                 }
                 
                 JSValueRef exception = NULL;
-                JSEvaluateScript(context, jsScript, NULL, NULL, 1, &exception);
+                JSEvaluateScript(jsContext, jsScript, NULL, NULL, 1, &exception);
                 if(exception) {
-                    printf("<JavaScript Evaluation Failed: %s>\n", [_ExceptionToString(context, exception) UTF8String]);
+                    printf("<JavaScript Evaluation Failed: %s>\n", [_ExceptionToString(jsContext, exception) UTF8String]);
                 } else {
                     jsString = JSStringCreateWithCFString(CFSTR("__wrapper"));
-                    JSObjectRef function = JSValueToObject(context, JSObjectGetProperty(context, JSContextGetGlobalObject(context), jsString, NULL), NULL);
+                    JSObjectRef function = JSValueToObject(jsContext, JSObjectGetProperty(jsContext, JSContextGetGlobalObject(jsContext), jsString, NULL), NULL);
                     JSStringRelease(jsString);
-                    if(function && JSValueIsObject(context, function)) {
-                        success = YES;
-                        void* params[3];
-                        params[0] = context;
-                        params[1] = function;
-                        params[2] = &success;
-                        _JavaScriptNodeFunctionApplier(root, params);
-                        [root applyFunctionOnChildren:_JavaScriptNodeFunctionApplier context:params];
-                        _ResetNodeFunctionApplier(root, context);
-                        [root applyFunctionOnChildren:_ResetNodeFunctionApplier context:context];
+                    if(function && JSValueIsObject(jsContext, function)) {
+                        JSValueProtect(jsContext, function);
+                        context = malloc(sizeof(struct __JavaScriptContext));
+                        context->context = jsContext;
+                        context->function = function;
                     }
                 }
                 
                 JSStringRelease(jsScript);
             }
-            JSGarbageCollect(context);
-            JSGlobalContextRelease(context);
+            if(context == NULL) {
+                JSGlobalContextRelease(jsContext);
+            }
         }
     }
     [pool release];
+    return context;
+}
+
+BOOL JavaScriptContextRunOnRootNode(JavaScriptContextRef context, ParserNode* root) {
+    BOOL success = NO;
+    if(context && root) {
+        NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+        success = YES;
+        void* params[3];
+        params[0] = context->context;
+        params[1] = context->function;
+        params[2] = &success;
+        _JavaScriptNodeFunctionApplier(root, params);
+        [root applyFunctionOnChildren:_JavaScriptNodeFunctionApplier context:params];
+        _ResetNodeFunctionApplier(root, context->context);
+        [root applyFunctionOnChildren:_ResetNodeFunctionApplier context:context->context];
+        JSGarbageCollect(context->context);
+        [pool release];
+    }
+    return success;
+}
+
+void JavaScriptContextRelease(JavaScriptContextRef context) {
+    if(context) {
+        JSValueUnprotect(context->context, context->function);
+        JSGarbageCollect(context->context);
+        JSGlobalContextRelease(context->context);
+        free(context);
+    }
+}
+
+BOOL RunJavaScriptOnRootNode(NSString* script, ParserNode* root) {
+    BOOL success = NO;
+    if(script.length && root) {
+        JavaScriptContextRef context = JavaScriptContextCreate(script);
+        if(context) {
+            success = JavaScriptContextRunOnRootNode(context, root);
+            JavaScriptContextRelease(context);
+        }
+    }
     return success;
 }
@@ -20,7 +20,13 @@
 
 static JSValueRef _GetPropertyType(JSContextRef ctx, JSObjectRef object, JSStringRef propertyName, JSValueRef* exception) {
     ParserNode* node = JSObjectGetPrivate(object);
-    return JSValueMakeNumber(ctx, (double)(long)[node class]);
+    return JSValueMakeNumber(ctx, node->_kind);
+}
+
+//Types are node kinds - Returns Nil if "value" is not a valid one
+static Class _ClassFromJSValue(JSContextRef ctx, JSValueRef value) {
+    double kind = JSValueToNumber(ctx, value, NULL);
+    return (kind >= 0.0) && (kind < (double)UINT32_MAX) ? _ClassOfKind(kind) : Nil;
 }
 
 static JSValueRef _GetPropertyName(JSContextRef ctx, JSObjectRef object, JSStringRef propertyName, JSValueRef* exception) {
@@ -98,7 +104,7 @@ static JSStaticValue _staticValues[] = {
 static JSValueRef _CallFunctionAddChild(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject, size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception) {
     if((argumentCount == 1) && JSValueIsObjectOfClass(ctx, arguments[0], _GetParserNodeJavaScriptClass())) {
         ParserNode* node = JSObjectGetPrivate(thisObject);
-        if(![node isKindOfClass:[ParserNodeText class]]) {
+        if(!IS_KIND(node, Text)) {
             ParserNode* child = JSObjectGetPrivate(JSValueToObject(ctx, arguments[0], NULL));
             [node addChild:child];
             return JSValueMakeUndefined(ctx);
@@ -135,7 +141,7 @@ static JSValueRef _CallFunctionIndexOfChild(JSContextRef ctx, JSObjectRef functi
 static JSValueRef _CallFunctionInsertChild(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject, size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception) {
     if((argumentCount == 2) && JSValueIsObjectOfClass(ctx, arguments[0], _GetParserNodeJavaScriptClass()) && JSValueIsNumber(ctx, arguments[1])) {
         ParserNode* node = JSObjectGetPrivate(thisObject);
-        if(![node isKindOfClass:[ParserNodeText class]]) {
+        if(!IS_KIND(node, Text)) {
             ParserNode* child = JSObjectGetPrivate(JSValueToObject(ctx, arguments[0], NULL));
             NSUInteger index = JSValueToNumber(ctx, arguments[1], NULL);
             [node insertChild:child atIndex:index];
@@ -247,12 +253,15 @@ static JSValueRef _CallFunctionFindPreviousSiblingOfType(JSContextRef ctx, JSObj
         ParserNode* node = JSObjectGetPrivate(thisObject);
         if(node.parent) {
             if(argumentCount == 1) {
-                Class class = (Class)(long)JSValueToNumber(ctx, arguments[0], NULL);
+                Class class = _ClassFromJSValue(ctx, arguments[0]);
                 return _JSValueMakeParserNode([node findPreviousSiblingOfClass:class], ctx);
             } else {
                 NSMutableSet* set = [NSMutableSet set];
                 for(size_t i = 0; i < argumentCount; ++i) {
-                    [set addObject:(Class)(long)JSValueToNumber(ctx, arguments[i], NULL)];
+                    Class class = _ClassFromJSValue(ctx, arguments[i]);
+                    if(class) {
+                        [set addObject:class];
+                    }
                 }
                 return _JSValueMakeParserNode([node findPreviousSiblingOfAnyClass:set], ctx);
             }
@@ -273,12 +282,15 @@ static JSValueRef _CallFunctionFindNextSiblingOfType(JSContextRef ctx, JSObjectR
         ParserNode* node = JSObjectGetPrivate(thisObject);
         if(node.parent) {
             if(argumentCount == 1) {
-                Class class = (Class)(long)JSValueToNumber(ctx, arguments[0], NULL);
+                Class class = _ClassFromJSValue(ctx, arguments[0]);
                 return _JSValueMakeParserNode([node findNextSiblingOfClass:class], ctx);
             } else {
                 NSMutableSet* set = [NSMutableSet set];
                 for(size_t i = 0; i < argumentCount; ++i) {
-                    [set addObject:(Class)(long)JSValueToNumber(ctx, arguments[i], NULL)];
+                    Class class = _ClassFromJSValue(ctx, arguments[i]);
+                    if(class) {
+                        [set addObject:class];
+                    }
                 }
                 return _JSValueMakeParserNode([node findNextSiblingOfAnyClass:set], ctx);
             }
@@ -299,12 +311,15 @@ static JSValueRef _CallFunctionFindFirstChildOfType(JSContextRef ctx, JSObjectRe
         ParserNode* node = JSObjectGetPrivate(thisObject);
         if(node.parent) {
             if(argumentCount == 1) {
-                Class class = (Class)(long)JSValueToNumber(ctx, arguments[0], NULL);
+                Class class = _ClassFromJSValue(ctx, arguments[0]);
                 return _JSValueMakeParserNode([node findFirstChildOfClass:class], ctx);
             } else {
                 NSMutableSet* set = [NSMutableSet set];
                 for(size_t i = 0; i < argumentCount; ++i) {
-                    [set addObject:(Class)(long)JSValueToNumber(ctx, arguments[i], NULL)];
+                    Class class = _ClassFromJSValue(ctx, arguments[i]);
+                    if(class) {
+                        [set addObject:class];
+                    }
                 }
                 return _JSValueMakeParserNode([node findFirstChildOfAnyClass:set], ctx);
             }
@@ -325,12 +340,15 @@ static JSValueRef _CallFunctionFindLastChildOfType(JSContextRef ctx, JSObjectRef
         ParserNode* node = JSObjectGetPrivate(thisObject);
         if(node.parent) {
             if(argumentCount == 1) {
-                Class class = (Class)(long)JSValueToNumber(ctx, arguments[0], NULL);
+                Class class = _ClassFromJSValue(ctx, arguments[0]);
                 return _JSValueMakeParserNode([node findLastChildOfClass:class], ctx);
             } else {
                 NSMutableSet* set = [NSMutableSet set];
                 for(size_t i = 0; i < argumentCount; ++i) {
-                    [set addObject:(Class)(long)JSValueToNumber(ctx, arguments[i], NULL)];
+                    Class class = _ClassFromJSValue(ctx, arguments[i]);
+                    if(class) {
+                        [set addObject:class];
+                    }
                 }
                 return _JSValueMakeParserNode([node findLastChildOfAnyClass:set], ctx);
             }
@@ -344,8 +362,8 @@ Fail:
 static JSValueRef _CallFunctionGetDepthInParentsOfType(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject, size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception) {
     if((argumentCount == 0) || ((argumentCount == 1) && JSValueIsNumber(ctx, arguments[0]))) {
         ParserNode* node = JSObjectGetPrivate(thisObject);
-        Class class = (argumentCount == 1 ? (Class)(long)JSValueToNumber(ctx, arguments[0], NULL) : nil);
-        return JSValueMakeNumber(ctx, [node getDepthInParentsOfClass:class]);
+        Class class = (argumentCount == 1 ? _ClassFromJSValue(ctx, arguments[0]) : nil);
+        return JSValueMakeNumber(ctx, (argumentCount == 1) && !class ? 0 : [node getDepthInParentsOfClass:class]);
     }
     *exception = _JSValueMakeException(ctx, @"Invalid argument(s)");
     return NULL;
@@ -354,7 +372,7 @@ static JSValueRef _CallFunctionGetDepthInParentsOfType(JSContextRef ctx, JSObjec
 static JSValueRef _CallFunctionIsWhitespace(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject, size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception) {
     if(argumentCount == 0) {
         ParserNode* node = JSObjectGetPrivate(thisObject);
-        return JSValueMakeBoolean(ctx, [node isKindOfClass:[ParserNodeWhitespace class]]);
+        return JSValueMakeBoolean(ctx, IS_KIND(node, Whitespace));
     }
     *exception = _JSValueMakeException(ctx, @"Invalid argument(s)");
     return NULL;
@@ -363,7 +381,7 @@ static JSValueRef _CallFunctionIsWhitespace(JSContextRef ctx, JSObjectRef functi
 static JSValueRef _CallFunctionIsWhitespaceOrNewline(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject, size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception) {
     if(argumentCount == 0) {
         ParserNode* node = JSObjectGetPrivate(thisObject);
-        return JSValueMakeBoolean(ctx, [node isKindOfClass:[ParserNodeWhitespace class]] || [node isKindOfClass:[ParserNodeNewline class]]);
+        return JSValueMakeBoolean(ctx, IS_KIND(node, Whitespace) || IS_KIND(node, Newline));
     }
     *exception = _JSValueMakeException(ctx, @"Invalid argument(s)");
     return NULL;
@@ -372,7 +390,7 @@ static JSValueRef _CallFunctionIsWhitespaceOrNewline(JSContextRef ctx, JSObjectR
 static JSValueRef _CallFunctionIsAnyText(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject, size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception) {
     if(argumentCount == 0) {
         ParserNode* node = JSObjectGetPrivate(thisObject);
-        return JSValueMakeBoolean(ctx, [node isKindOfClass:[ParserNodeText class]]);
+        return JSValueMakeBoolean(ctx, IS_KIND(node, Text));
     }
     *exception = _JSValueMakeException(ctx, @"Invalid argument(s)");
     return NULL;
@@ -381,7 +399,7 @@ static JSValueRef _CallFunctionIsAnyText(JSContextRef ctx, JSObjectRef function,
 static JSValueRef _CallFunctionIsKeyword(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject, size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception) {
     if(argumentCount == 0) {
         ParserNode* node = JSObjectGetPrivate(thisObject);
-        return JSValueMakeBoolean(ctx, [node isKindOfClass:[ParserNodeKeyword class]]);
+        return JSValueMakeBoolean(ctx, IS_KIND(node, Keyword));
     }
     *exception = _JSValueMakeException(ctx, @"Invalid argument(s)");
     return NULL;
@@ -390,7 +408,7 @@ static JSValueRef _CallFunctionIsKeyword(JSContextRef ctx, JSObjectRef function,
 static JSValueRef _CallFunctionIsToken(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject, size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception) {
     if(argumentCount == 0) {
         ParserNode* node = JSObjectGetPrivate(thisObject);
-        return JSValueMakeBoolean(ctx, [node isKindOfClass:[ParserNodeToken class]]);
+        return JSValueMakeBoolean(ctx, IS_KIND(node, Token));
     }
     *exception = _JSValueMakeException(ctx, @"Invalid argument(s)");
     return NULL;
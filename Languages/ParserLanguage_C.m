@@ -21,7 +21,7 @@
 
 @interface ParserLanguageC : ParserLanguage <ParserLanguageCTopLevelNodeClasses> {
 @private
-    NSMutableDictionary* _topLevelNodeClasses;
+    NSMutableDictionary* _topLevelKinds; //Kinds of top-level node classes for each top-level language
 }
 @end
 
@@ -104,15 +104,19 @@
     return 2;
 }
 
++ (BOOL) languageAllowsReparseBoundary:(Class)nodeClass {
+    return NO; //Nodes are analyzed differently depending on whether they are at top-level
+}
+
 - (id) init {
     if((self = [super init])) {
-        _topLevelNodeClasses = [[NSMutableDictionary alloc] init];
+        _topLevelKinds = [[NSMutableDictionary alloc] init];
     }
     return self;
 }
 
 - (void) dealloc {
-    [_topLevelNodeClasses release];
+    [_topLevelKinds release];
     
     [super dealloc];
 }
@@ -137,9 +141,13 @@ static inline BOOL _IsIdentifier(const unichar* buffer, NSUInteger length) {
     return YES;
 }
 
-static inline BOOL _IsNodeAtTopLevel(ParserNode* node, NSSet* topLevelClasses) {
+static inline BOOL _IsNodeMemberOfAnyKind(ParserNode* node, const uint64_t* kinds) {
+    return node && _IsKindInMask(node->_kind, kinds);
+}
+
+static inline BOOL _IsNodeAtTopLevel(ParserNode* node, const uint64_t* topLevelKinds) {
     while(node.parent) {
-        if(![topLevelClasses containsObject:[node.parent class]] && !([node.parent isKindOfClass:[ParserNodeBraces class]] && [topLevelClasses containsObject:[node.parent.parent class]])) {
+        if(!_IsNodeMemberOfAnyKind(node.parent, topLevelKinds) && !(IS_KIND(node.parent, Braces) && _IsNodeMemberOfAnyKind(node.parent.parent, topLevelKinds))) {
             return NO;
         }
         node = node.parent;
@@ -147,257 +155,310 @@ static inline BOOL _IsNodeAtTopLevel(ParserNode* node, NSSet* topLevelClasses) {
     return YES;
 }
 
-- (NSSet*) _topLevelNodeClassesForLanguage:(ParserLanguage*)language {
-    NSMutableSet* set = [_topLevelNodeClasses objectForKey:language];
-    if(set == nil) {
-        set = [[NSMutableSet alloc] init];
-        for(ParserLanguage* sublanguage in language.allLanguageDependencies) {
-            if([sublanguage conformsToProtocol:@protocol(ParserLanguageCTopLevelNodeClasses)]) {
-                [set unionSet:[[sublanguage class] languageTopLevelNodeClasses]];
+/* Languages may be analyzing on several threads at once - Masks are never removed so their bytes remain valid outside of the lock */
+- (const uint64_t*) _topLevelKindsForLanguage:(ParserLanguage*)language {
+    NSData* data;
+    @synchronized(self) {
+        data = [_topLevelKinds objectForKey:language];
+        if(data == nil) {
+            NSMutableData* mask = [[NSMutableData alloc] initWithLength:(_kindMaskWords * sizeof(uint64_t))];
+            for(ParserLanguage* sublanguage in language.allLanguageDependencies) {
+                if([sublanguage conformsToProtocol:@protocol(ParserLanguageCTopLevelNodeClasses)]) {
+                    for(Class class in [[sublanguage class] languageTopLevelNodeClasses]) {
+                        _AddKindToMask(_KindOfClass(class), mask.mutableBytes);
+                    }
+                }
             }
+            data = [mask copy];
+            [_topLevelKinds setObject:data forKey:language];
+            [data release];
+            [mask release];
         }
-        [_topLevelNodeClasses setObject:set forKey:language];
-        [set release];
     }
-    return set;
+    return data.bytes;
 }
 
-- (ParserNode*) performSyntaxAnalysis:(NSUInteger)passIndex forNode:(ParserNode*)node textBuffer:(const unichar*)textBuffer topLevelLanguage:(ParserLanguage*)topLevelLanguage {
+static ParserNode* _AnalyzeBraces(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    ParserNode* previousNode = [node findPreviousSiblingIgnoringWhitespaceAndNewline];
     
-    if(passIndex == 0) {
-        if([node isKindOfClass:[ParserNodeBraces class]]) {
-            ParserNode* previousNode = [node findPreviousSiblingIgnoringWhitespaceAndNewline];
-            
-            // "if() {}" "else if() {}" "for() {}" "switch() {}" "while() {}"
-            if([previousNode isKindOfClass:[ParserNodeParenthesis class]]) {
-                previousNode = [previousNode findPreviousSiblingIgnoringWhitespaceAndNewline];
-                if([previousNode isKindOfClass:[ParserNodeCConditionIf class]] || [previousNode isKindOfClass:[ParserNodeCConditionElseIf class]] || [previousNode isKindOfClass:[ParserNodeCFlowFor class]]
-                    || [previousNode isKindOfClass:[ParserNodeCFlowSwitch class]] || [previousNode isKindOfClass:[ParserNodeCFlowWhile class]]) {
-                       _RearrangeNodesAsParentAndChildren(previousNode, node);
-                }
-            }
-            
-            // "do {} while()"
-            else if([previousNode isKindOfClass:[ParserNodeCFlowDoWhile class]]) {
-                ParserNode* nextNode = [node findNextSiblingIgnoringWhitespaceAndNewline];
-                if([nextNode isKindOfClass:[ParserNodeCFlowWhile class]]) {
-                    ParserNode* nextNextNode = [nextNode findNextSiblingIgnoringWhitespaceAndNewline];
-                    if([nextNextNode isKindOfClass:[ParserNodeParenthesis class]]) {
-                        _RearrangeNodesAsParentAndChildren(previousNode, nextNextNode);
-                        
-                        [nextNode replaceWithNodeOfClass:[ParserNodeMatch class] preserveChildren:NO];
-                    }
-                }
-            }
-            
-        } else if([node isKindOfClass:[ParserNodeCConditionElse class]]) {
-            
-            // "else {}" "else"
-            ParserNode* nextNode = [node findNextSiblingIgnoringWhitespaceAndNewline];
-            if(![nextNode isKindOfClass:[ParserNodeCConditionIf class]]) {
-                ParserNode* bracesNode = [node findNextSiblingOfClass:[ParserNodeBraces class]];
-                ParserNode* semicolonNode = [node findNextSiblingOfClass:[ParserNodeSemicolon class]];
-                if(bracesNode && (!semicolonNode || ([node.parent indexOfChild:bracesNode] < [node.parent indexOfChild:semicolonNode]))) {
-                    _RearrangeNodesAsParentAndChildren(node, bracesNode);
-                } else if(semicolonNode && (!bracesNode || ([node.parent indexOfChild:semicolonNode] < [node.parent indexOfChild:bracesNode]))) {
-                    _RearrangeNodesAsParentAndChildren(node, semicolonNode);
-                }
-            }
-            
-        } else if([node isKindOfClass:[ParserNodeCConditionIf class]] || [node isKindOfClass:[ParserNodeCConditionElseIf class]] || [node isKindOfClass:[ParserNodeCFlowFor class]] || [node isKindOfClass:[ParserNodeCFlowSwitch class]]) {
-            
-            // "if()" "else if()" "for()" "switch()"
-            ParserNode* nextNode = [node findNextSiblingIgnoringWhitespaceAndNewline];
-            if([nextNode isKindOfClass:[ParserNodeParenthesis class]]) {
-                ParserNode* bracesNode = [nextNode findNextSiblingOfClass:[ParserNodeBraces class]];
-                ParserNode* semicolonNode = [nextNode findNextSiblingOfClass:[ParserNodeSemicolon class]];
-                if(semicolonNode && (!bracesNode || ([node.parent indexOfChild:semicolonNode] < [node.parent indexOfChild:bracesNode]))) {
-                    _RearrangeNodesAsParentAndChildren(node, semicolonNode);
-                }
-            }
-            
-        } else if([node isKindOfClass:[ParserNodeCFlowCase class]] || [node isKindOfClass:[ParserNodeCFlowDefault class]]) {
-            
-            // "case:" "case: break" "default:" "default: break"
-            ParserNode* endNode = [node.parent lastChild];
-            if([endNode isKindOfClass:[ParserNodeWhitespace class]] || [endNode isKindOfClass:[ParserNodeNewline class]]) {
-                endNode = [endNode findPreviousSiblingIgnoringWhitespaceAndNewline];
-            }
-            ParserNode* breakNode = [node findNextSiblingOfClass:[ParserNodeCFlowBreak class]];
-            if(breakNode && (breakNode.range.location < endNode.range.location)) {
-                endNode = [breakNode findNextSiblingOfClass:[ParserNodeSemicolon class]];
-            }
-            ParserNode* caseNode = [node findNextSiblingOfClass:[ParserNodeCFlowCase class]];
-            if(caseNode && (caseNode.range.location < endNode.range.location)) {
-                endNode = caseNode.previousSibling;
-            }
-            ParserNode* defaultNode = [node findNextSiblingOfClass:[ParserNodeCFlowDefault class]];
-            if(defaultNode && (defaultNode.range.location < endNode.range.location)) {
-                endNode = defaultNode.previousSibling;
-            }
-            
-            _RearrangeNodesAsParentAndChildren(node, endNode);
-            
-        } else if([node isKindOfClass:[ParserNodeCFlowReturn class]]) {
-            
-            // "return" "return foo"
-            ParserNode* semicolonNode = [node findNextSiblingOfClass:[ParserNodeSemicolon class]];
-            if(semicolonNode) {
-                if(semicolonNode.previousSibling != node) {
-                    _RearrangeNodesAsParentAndChildren(node, semicolonNode);
-                }
-            } else {
-                if([node.parent isKindOfClass:[ParserNodeCConditionIf class]] || [node.parent isKindOfClass:[ParserNodeCConditionElse class]] || [node.parent isKindOfClass:[ParserNodeCConditionElseIf class]]
-                    || [node.parent isKindOfClass:[ParserNodeCFlowFor class]] || [node.parent isKindOfClass:[ParserNodeCFlowWhile class]]) {
-                    _RearrangeNodesAsParentAndChildren(node, node.parent.lastChild);
-                }
+    // "if() {}" "else if() {}" "for() {}" "switch() {}" "while() {}"
+    if(IS_KIND(previousNode, Parenthesis)) {
+        previousNode = [previousNode findPreviousSiblingIgnoringWhitespaceAndNewline];
+        if(IS_KIND(previousNode, CConditionIf) || IS_KIND(previousNode, CConditionElseIf) || IS_KIND(previousNode, CFlowFor)
+            || IS_KIND(previousNode, CFlowSwitch) || IS_KIND(previousNode, CFlowWhile)) {
+               _RearrangeNodesAsParentAndChildren(previousNode, node);
+        }
+    }
+    
+    // "do {} while()"
+    else if(IS_KIND(previousNode, CFlowDoWhile)) {
+        ParserNode* nextNode = [node findNextSiblingIgnoringWhitespaceAndNewline];
+        if(IS_KIND(nextNode, CFlowWhile)) {
+            ParserNode* nextNextNode = [nextNode findNextSiblingIgnoringWhitespaceAndNewline];
+            if(IS_KIND(nextNextNode, Parenthesis)) {
+                _RearrangeNodesAsParentAndChildren(previousNode, nextNextNode);
+                
+                [nextNode replaceWithNodeOfClass:[ParserNodeMatch class] preserveChildren:NO];
             }
-            
-        } else if([node isKindOfClass:[ParserNodeCFlowGoto class]]) {
-            
-            // "goto foo"
-            ParserNode* semicolonNode = [node findNextSiblingOfClass:[ParserNodeSemicolon class]];
-            if(semicolonNode) {
-                _RearrangeNodesAsParentAndChildren(node, semicolonNode);
-            } else {
-                if([node.parent isKindOfClass:[ParserNodeCConditionIf class]] || [node.parent isKindOfClass:[ParserNodeCConditionElse class]] || [node.parent isKindOfClass:[ParserNodeCConditionElseIf class]]
-                    || [node.parent isKindOfClass:[ParserNodeCFlowFor class]] || [node.parent isKindOfClass:[ParserNodeCFlowWhile class]]) {
-                    _RearrangeNodesAsParentAndChildren(node, node.parent.lastChild);
-                }
+        }
+    }
+    
+    return node;
+}
+
+static ParserNode* _AnalyzeConditionElse(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    // "else {}" "else"
+    ParserNode* nextNode = [node findNextSiblingIgnoringWhitespaceAndNewline];
+    if(!IS_KIND(nextNode, CConditionIf)) {
+        ParserNode* bracesNode = [node findNextSiblingOfClass:[ParserNodeBraces class]];
+        ParserNode* semicolonNode = [node findNextSiblingOfClass:[ParserNodeSemicolon class]];
+        if(bracesNode && (!semicolonNode || ([node.parent indexOfChild:bracesNode] < [node.parent indexOfChild:semicolonNode]))) {
+            _RearrangeNodesAsParentAndChildren(node, bracesNode);
+        } else if(semicolonNode && (!bracesNode || ([node.parent indexOfChild:semicolonNode] < [node.parent indexOfChild:bracesNode]))) {
+            _RearrangeNodesAsParentAndChildren(node, semicolonNode);
+        }
+    }
+    
+    return node;
+}
+
+static ParserNode* _AnalyzeConditionOrLoop(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    // "if()" "else if()" "for()" "switch()"
+    ParserNode* nextNode = [node findNextSiblingIgnoringWhitespaceAndNewline];
+    if(IS_KIND(nextNode, Parenthesis)) {
+        ParserNode* bracesNode = [nextNode findNextSiblingOfClass:[ParserNodeBraces class]];
+        ParserNode* semicolonNode = [nextNode findNextSiblingOfClass:[ParserNodeSemicolon class]];
+        if(semicolonNode && (!bracesNode || ([node.parent indexOfChild:semicolonNode] < [node.parent indexOfChild:bracesNode]))) {
+            _RearrangeNodesAsParentAndChildren(node, semicolonNode);
+        }
+    }
+    
+    return node;
+}
+
+static ParserNode* _AnalyzeCaseOrDefault(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    // "case:" "case: break" "default:" "default: break"
+    ParserNode* endNode = [node.parent lastChild];
+    if(IS_KIND(endNode, Whitespace) || IS_KIND(endNode, Newline)) {
+        endNode = [endNode findPreviousSiblingIgnoringWhitespaceAndNewline];
+    }
+    ParserNode* breakNode = [node findNextSiblingOfClass:[ParserNodeCFlowBreak class]];
+    if(breakNode && (breakNode.range.location < endNode.range.location)) {
+        endNode = [breakNode findNextSiblingOfClass:[ParserNodeSemicolon class]];
+    }
+    ParserNode* caseNode = [node findNextSiblingOfClass:[ParserNodeCFlowCase class]];
+    if(caseNode && (caseNode.range.location < endNode.range.location)) {
+        endNode = caseNode.previousSibling;
+    }
+    ParserNode* defaultNode = [node findNextSiblingOfClass:[ParserNodeCFlowDefault class]];
+    if(defaultNode && (defaultNode.range.location < endNode.range.location)) {
+        endNode = defaultNode.previousSibling;
+    }
+    
+    _RearrangeNodesAsParentAndChildren(node, endNode);
+    
+    return node;
+}
+
+static ParserNode* _AnalyzeReturn(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    // "return" "return foo"
+    ParserNode* semicolonNode = [node findNextSiblingOfClass:[ParserNodeSemicolon class]];
+    if(semicolonNode) {
+        if(semicolonNode.previousSibling != node) {
+            _RearrangeNodesAsParentAndChildren(node, semicolonNode);
+        }
+    } else {
+        if(IS_KIND(node.parent, CConditionIf) || IS_KIND(node.parent, CConditionElse) || IS_KIND(node.parent, CConditionElseIf)
+            || IS_KIND(node.parent, CFlowFor) || IS_KIND(node.parent, CFlowWhile)) {
+            _RearrangeNodesAsParentAndChildren(node, node.parent.lastChild);
+        }
+    }
+    
+    return node;
+}
+
+static ParserNode* _AnalyzeGoto(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    // "goto foo"
+    ParserNode* semicolonNode = [node findNextSiblingOfClass:[ParserNodeSemicolon class]];
+    if(semicolonNode) {
+        _RearrangeNodesAsParentAndChildren(node, semicolonNode);
+    } else {
+        if(IS_KIND(node.parent, CConditionIf) || IS_KIND(node.parent, CConditionElse) || IS_KIND(node.parent, CConditionElseIf)
+            || IS_KIND(node.parent, CFlowFor) || IS_KIND(node.parent, CFlowWhile)) {
+            _RearrangeNodesAsParentAndChildren(node, node.parent.lastChild);
+        }
+    }
+    
+    return node;
+}
+
+static ParserNode* _AnalyzeColon(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    if(IS_KIND(node.parent, Braces)) {
+        // "foo:"
+        ParserNode* labelNode = [node findPreviousSiblingIgnoringWhitespaceAndNewline];
+        if(IS_MEMBER_OF_KIND(labelNode, Text)) {
+            ParserNode* previousNode = [labelNode findPreviousSiblingIgnoringWhitespaceAndNewline];
+            if(!IS_KIND(previousNode, QuestionMark)) {
+                ParserNode* newNode = [[ParserNodeCFlowLabel alloc] initWithText:labelNode.text range:NSMakeRange(labelNode.range.location, 0)];
+                [labelNode insertPreviousSibling:newNode];
+                [newNode release];
+                
+                _RearrangeNodesAsParentAndChildren(newNode, node);
             }
-            
-        } else if([node isKindOfClass:[ParserNodeColon class]] && [node.parent isKindOfClass:[ParserNodeBraces class]]) {
-            
-            // "foo:"
-            ParserNode* labelNode = [node findPreviousSiblingIgnoringWhitespaceAndNewline];
-            if([labelNode isMemberOfClass:[ParserNodeText class]]) {
-                ParserNode* previousNode = [labelNode findPreviousSiblingIgnoringWhitespaceAndNewline];
-                if(![previousNode isKindOfClass:[ParserNodeQuestionMark class]]) {
-                    ParserNode* newNode = [[ParserNodeCFlowLabel alloc] initWithText:labelNode.text range:NSMakeRange(labelNode.range.location, 0)];
-                    [labelNode insertPreviousSibling:newNode];
+        }
+    }
+    
+    return node;
+}
+
+static ParserNode* _AnalyzeQuestionMark(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    // "foo ? bar : baz" "(foo) ? (bar) : (baz)"
+    ParserNode* startNode = [node findPreviousSiblingIgnoringWhitespaceAndNewline];
+    if(IS_MEMBER_OF_KIND(startNode, Text) || IS_KIND(startNode, Parenthesis)) {
+        ParserNode* middleNode = [node findNextSiblingIgnoringWhitespaceAndNewline];
+        if(IS_MEMBER_OF_KIND(middleNode, Text) || IS_KIND(middleNode, Parenthesis)) {
+            ParserNode* colonNode = [middleNode findNextSiblingIgnoringWhitespaceAndNewline];
+            if(IS_KIND(colonNode, Colon)) {
+                ParserNode* endNode = [colonNode findNextSiblingIgnoringWhitespaceAndNewline];
+                if(IS_MEMBER_OF_KIND(endNode, Text) || IS_KIND(endNode, Parenthesis)) {
+                    ParserNode* newNode = [[ParserNodeCConditionalOperator alloc] initWithText:startNode.text range:NSMakeRange(startNode.range.location, 0)];
+                    [startNode insertPreviousSibling:newNode];
                     [newNode release];
                     
-                    _RearrangeNodesAsParentAndChildren(newNode, node);
-                }
-            }
-            
-        } else if([node isKindOfClass:[ParserNodeQuestionMark class]]) {
-            
-            // "foo ? bar : baz" "(foo) ? (bar) : (baz)"
-            ParserNode* startNode = [node findPreviousSiblingIgnoringWhitespaceAndNewline];
-            if([startNode isMemberOfClass:[ParserNodeText class]] || [startNode isKindOfClass:[ParserNodeParenthesis class]]) {
-                ParserNode* middleNode = [node findNextSiblingIgnoringWhitespaceAndNewline];
-                if([middleNode isMemberOfClass:[ParserNodeText class]] || [middleNode isKindOfClass:[ParserNodeParenthesis class]]) {
-                    ParserNode* colonNode = [middleNode findNextSiblingIgnoringWhitespaceAndNewline];
-                    if([colonNode isKindOfClass:[ParserNodeColon class]]) {
-                        ParserNode* endNode = [colonNode findNextSiblingIgnoringWhitespaceAndNewline];
-                        if([endNode isMemberOfClass:[ParserNodeText class]] || [endNode isKindOfClass:[ParserNodeParenthesis class]]) {
-                            ParserNode* newNode = [[ParserNodeCConditionalOperator alloc] initWithText:startNode.text range:NSMakeRange(startNode.range.location, 0)];
-                            [startNode insertPreviousSibling:newNode];
-                            [newNode release];
-                            
-                            _RearrangeNodesAsParentAndChildren(newNode, endNode);
-                        }
-                    }
+                    _RearrangeNodesAsParentAndChildren(newNode, endNode);
                 }
             }
-            
-        } else if([node isKindOfClass:[ParserNodeCTypeEnum class]] || [node isKindOfClass:[ParserNodeCTypeStruct class]] || [node isKindOfClass:[ParserNodeCTypeUnion class]]) {
-            
-            // "enum {}" "struct {}" "union {}"
-            ParserNode* bracesNode = [node findNextSiblingOfClass:[ParserNodeBraces class]];
-            ParserNode* semicolonNode = [node findNextSiblingOfClass:[ParserNodeSemicolon class]];
-            if(bracesNode && (!semicolonNode || ([node.parent indexOfChild:semicolonNode] > [node.parent indexOfChild:bracesNode]))) {
-                if(!semicolonNode) {
-                    _RearrangeNodesAsParentAndChildren(node, node.parent.lastChild);
-                } else {
-                    _RearrangeNodesAsParentAndChildren(node, semicolonNode);
-                }
-            }
-            
-        } else if([node isKindOfClass:[ParserNodeCTypedef class]]) {
-            
-            // "typedef foo"
-            ParserNode* semicolonNode = [node findNextSiblingOfClass:[ParserNodeSemicolon class]];
-            if(semicolonNode) {
-                _RearrangeNodesAsParentAndChildren(node, semicolonNode);
-            }
-            
-        } else if([node isKindOfClass:[ParserNodeCSizeOf class]] || [node isKindOfClass:[ParserNodeCTypeOf class]]) {
-            
-            // "sizeof()" "typeof()"
-            ParserNode* nextNode = [node findNextSiblingIgnoringWhitespaceAndNewline];
-            if([nextNode isKindOfClass:[ParserNodeParenthesis class]]) {
-                _RearrangeNodesAsParentAndChildren(node, nextNode);
-            }
-            
         }
     }
     
-    if(passIndex == 1) {
-        if([node isKindOfClass:[ParserNodeParenthesis class]] && ![node.parent isKindOfClass:[ParserNodeCPreprocessorDefine class]]) {
+    return node;
+}
+
+static ParserNode* _AnalyzeCompositeType(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    // "enum {}" "struct {}" "union {}"
+    ParserNode* bracesNode = [node findNextSiblingOfClass:[ParserNodeBraces class]];
+    ParserNode* semicolonNode = [node findNextSiblingOfClass:[ParserNodeSemicolon class]];
+    if(bracesNode && (!semicolonNode || ([node.parent indexOfChild:semicolonNode] > [node.parent indexOfChild:bracesNode]))) {
+        if(!semicolonNode) {
+            _RearrangeNodesAsParentAndChildren(node, node.parent.lastChild);
+        } else {
+            _RearrangeNodesAsParentAndChildren(node, semicolonNode);
+        }
+    }
+    
+    return node;
+}
+
+static ParserNode* _AnalyzeTypedef(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    // "typedef foo"
+    ParserNode* semicolonNode = [node findNextSiblingOfClass:[ParserNodeSemicolon class]];
+    if(semicolonNode) {
+        _RearrangeNodesAsParentAndChildren(node, semicolonNode);
+    }
+    
+    return node;
+}
+
+static ParserNode* _AnalyzeSizeOfOrTypeOf(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    // "sizeof()" "typeof()"
+    ParserNode* nextNode = [node findNextSiblingIgnoringWhitespaceAndNewline];
+    if(IS_KIND(nextNode, Parenthesis)) {
+        _RearrangeNodesAsParentAndChildren(node, nextNode);
+    }
+    
+    return node;
+}
+
+static ParserNode* _AnalyzeParenthesis(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    if(!IS_KIND(node.parent, CPreprocessorDefine)) {
+        ParserNode* previousNode = [node findPreviousSiblingIgnoringWhitespaceAndNewline];
+        if(IS_MEMBER_OF_KIND(previousNode, Text) && _IsIdentifier(textBuffer + previousNode.range.location, previousNode.range.length)) {
+            ParserNode* semicolonNode = [node findNextSiblingOfClass:[ParserNodeSemicolon class]];
+            ParserNode* bracesNode = [node findNextSiblingOfClass:[ParserNodeBraces class]];
             
-            ParserNode* previousNode = [node findPreviousSiblingIgnoringWhitespaceAndNewline];
-            if([previousNode isMemberOfClass:[ParserNodeText class]] && _IsIdentifier(textBuffer + previousNode.range.location, previousNode.range.length)) {
-                ParserNode* semicolonNode = [node findNextSiblingOfClass:[ParserNodeSemicolon class]];
-                ParserNode* bracesNode = [node findNextSiblingOfClass:[ParserNodeBraces class]];
+            // "foo bar() {}"
+            if(bracesNode && (!semicolonNode || (semicolonNode.range.location > bracesNode.range.location))) {
+                previousNode = [previousNode replaceWithNodeOfClass:[ParserNodeMatch class] preserveChildren:NO];
+                while(1) {
+                    ParserNode* siblingNode = [previousNode findPreviousSiblingIgnoringWhitespaceAndNewline];
+                    if(!IS_MEMBER_OF_KIND(siblingNode, Text) && !IS_KIND(siblingNode, Keyword) && !IS_KIND(siblingNode, Asterisk)) {
+                        break;
+                    }
+                    previousNode = siblingNode;
+                }
+                ParserNode* newNode = [[ParserNodeCFunctionDefinition alloc] initWithText:previousNode.text range:NSMakeRange(previousNode.range.location, 0)];
+                [previousNode insertPreviousSibling:newNode];
+                [newNode release];
+                _RearrangeNodesAsParentAndChildren(newNode, bracesNode);
+            } else {
                 
-                // "foo bar() {}"
-                if(bracesNode && (!semicolonNode || (semicolonNode.range.location > bracesNode.range.location))) {
+                // "foo bar()"
+                if(_IsNodeAtTopLevel(node, [(ParserLanguageC*)language _topLevelKindsForLanguage:topLevelLanguage]) && semicolonNode) {
                     previousNode = [previousNode replaceWithNodeOfClass:[ParserNodeMatch class] preserveChildren:NO];
                     while(1) {
                         ParserNode* siblingNode = [previousNode findPreviousSiblingIgnoringWhitespaceAndNewline];
-                        if(![siblingNode isMemberOfClass:[ParserNodeText class]] && ![siblingNode isKindOfClass:[ParserNodeKeyword class]] && ![siblingNode isKindOfClass:[ParserNodeAsterisk class]]) {
+                        if(!IS_MEMBER_OF_KIND(siblingNode, Text) && !IS_KIND(siblingNode, Keyword) && !IS_KIND(siblingNode, Asterisk)) {
                             break;
                         }
                         previousNode = siblingNode;
                     }
-                    ParserNode* newNode = [[ParserNodeCFunctionDefinition alloc] initWithText:previousNode.text range:NSMakeRange(previousNode.range.location, 0)];
+                    ParserNode* newNode = [[ParserNodeCFunctionPrototype alloc] initWithText:previousNode.text range:NSMakeRange(previousNode.range.location, 0)];
                     [previousNode insertPreviousSibling:newNode];
                     [newNode release];
-                    _RearrangeNodesAsParentAndChildren(newNode, bracesNode);
-                } else {
-                    
-                    // "foo bar()"
-                    if(_IsNodeAtTopLevel(node, [self _topLevelNodeClassesForLanguage:topLevelLanguage]) && semicolonNode) {
-                        previousNode = [previousNode replaceWithNodeOfClass:[ParserNodeMatch class] preserveChildren:NO];
-                        while(1) {
-                            ParserNode* siblingNode = [previousNode findPreviousSiblingIgnoringWhitespaceAndNewline];
-                            if(![siblingNode isMemberOfClass:[ParserNodeText class]] && ![siblingNode isKindOfClass:[ParserNodeKeyword class]] && ![siblingNode isKindOfClass:[ParserNodeAsterisk class]]) {
-                                break;
-                            }
-                            previousNode = siblingNode;
-                        }
-                        ParserNode* newNode = [[ParserNodeCFunctionPrototype alloc] initWithText:previousNode.text range:NSMakeRange(previousNode.range.location, 0)];
-                        [previousNode insertPreviousSibling:newNode];
-                        [newNode release];
-                        _RearrangeNodesAsParentAndChildren(newNode, semicolonNode);
-                    }
-                    
-                    // "foo(bar)"
-                    else {
-                        previousNode = [previousNode replaceWithNodeOfClass:[ParserNodeMatch class] preserveChildren:NO];
-                        ParserNode* newNode = [[ParserNodeCFunctionCall alloc] initWithText:previousNode.text range:NSMakeRange(previousNode.range.location, 0)];
-                        [previousNode insertPreviousSibling:newNode];
-                        [newNode release];
-                        _RearrangeNodesAsParentAndChildren(newNode, node);
-                    }
-                    
+                    _RearrangeNodesAsParentAndChildren(newNode, semicolonNode);
+                }
+                
+                // "foo(bar)"
+                else {
+                    previousNode = [previousNode replaceWithNodeOfClass:[ParserNodeMatch class] preserveChildren:NO];
+                    ParserNode* newNode = [[ParserNodeCFunctionCall alloc] initWithText:previousNode.text range:NSMakeRange(previousNode.range.location, 0)];
+                    [previousNode insertPreviousSibling:newNode];
+                    [newNode release];
+                    _RearrangeNodesAsParentAndChildren(newNode, node);
                 }
+                
             }
-            
         }
     }
     
-    //FIXME: Add support for blocks
-    
     return node;
 }
 
+//FIXME: Add support for blocks
++ (const ParserSyntaxAnalysisRule*) languageSyntaxAnalysisRules {
+    static const ParserSyntaxAnalysisRule rules[] = {
+        {0, "ParserNodeBraces", _AnalyzeBraces},
+        {0, "ParserNodeCConditionElse", _AnalyzeConditionElse},
+        {0, "ParserNodeCConditionIf", _AnalyzeConditionOrLoop},
+        {0, "ParserNodeCConditionElseIf", _AnalyzeConditionOrLoop},
+        {0, "ParserNodeCFlowFor", _AnalyzeConditionOrLoop},
+        {0, "ParserNodeCFlowSwitch", _AnalyzeConditionOrLoop},
+        {0, "ParserNodeCFlowCase", _AnalyzeCaseOrDefault},
+        {0, "ParserNodeCFlowDefault", _AnalyzeCaseOrDefault},
+        {0, "ParserNodeCFlowReturn", _AnalyzeReturn},
+        {0, "ParserNodeCFlowGoto", _AnalyzeGoto},
+        {0, "ParserNodeColon", _AnalyzeColon},
+        {0, "ParserNodeQuestionMark", _AnalyzeQuestionMark},
+        {0, "ParserNodeCTypeEnum", _AnalyzeCompositeType},
+        {0, "ParserNodeCTypeStruct", _AnalyzeCompositeType},
+        {0, "ParserNodeCTypeUnion", _AnalyzeCompositeType},
+        {0, "ParserNodeCTypedef", _AnalyzeTypedef},
+        {0, "ParserNodeCSizeOf", _AnalyzeSizeOfOrTypeOf},
+        {0, "ParserNodeCTypeOf", _AnalyzeSizeOfOrTypeOf},
+        {1, "ParserNodeParenthesis", _AnalyzeParenthesis},
+        {0, NULL, NULL}
+    };
+    return rules;
+}
+
 @end
 
 @implementation ParserNodeCComment
 
++ (NSString*) prefixCharacters {
+    return @"/";
+}
+
 + (NSUInteger) isMatchingPrefix:(const unichar*)string maxLength:(NSUInteger)maxLength {
     return (string[0] == '/') && (string[1] == '*') ? 2 : NSNotFound;
 }
@@ -406,6 +467,8 @@ static inline BOOL _IsNodeAtTopLevel(ParserNode* node, NSSet* topLevelClasses) {
     return (string[0] == '*') && (string[1] == '/') ? 2 : NSNotFound;
 }
 
+TERMINATOR_METHOD("*/", 0)
+
 - (NSString*) cleanContent {
     NSRange range = self.range;
     return [self.text substringWithRange:NSMakeRange(range.location + 2, range.length - 4)];
@@ -427,6 +490,10 @@ static inline BOOL _IsNodeAtTopLevel(ParserNode* node, NSSet* topLevelClasses) {
     return NO;
 }
 
++ (NSString*) suffixCharacters {
+    return @" \t\r\n#/";
+}
+
 + (NSUInteger) isMatchingSuffix:(const unichar*)string maxLength:(NSUInteger)maxLength {
     while(maxLength) {
         if(IsNewline(*string) || (*string == '#') || ((string[0] == '/') && ((string[1] == '*') || (string[1] == '/')))) {
@@ -451,6 +518,10 @@ static inline BOOL _IsNodeAtTopLevel(ParserNode* node, NSSet* topLevelClasses) {
 
 @implementation ParserNodeCPreprocessorCondition
 
++ (NSString*) suffixCharacters {
+    return @"#";
+}
+
 + (NSUInteger) isMatchingSuffix:(const unichar*)string maxLength:(NSUInteger)maxLength {
     {
         IS_MATCHING_CHARACTERS_EXTENDED("#else", true, NULL, string, maxLength);
@@ -479,6 +550,8 @@ static inline BOOL _IsNodeAtTopLevel(ParserNode* node, NSSet* topLevelClasses) {
 #define IMPLEMENTATION(__NAME__, __PREFIX__, __CHARACTERS__) \
 @implementation ParserNodeCPreprocessorCondition##__NAME__ \
 \
+PREFIX_CHARACTERS_METHOD(__PREFIX__) \
+\
 + (NSUInteger) isMatchingPrefix:(const unichar*)string maxLength:(NSUInteger)maxLength { \
     IS_MATCHING_CHARACTERS_EXTENDED(__PREFIX__, true, __CHARACTERS__, string, maxLength) \
     if(_matching != NSNotFound) { \
@@ -543,6 +616,10 @@ IMPLEMENTATION(Include, "#include", true, NULL)
 
 @implementation ParserNodeCCharacterLiteral
 
++ (NSString*) prefixCharacters {
+    return @"'";
+}
+
 + (NSUInteger) isMatchingPrefix:(const unichar*)string maxLength:(NSUInteger)maxLength {
     return (*string == '\'') ? 1 : NSNotFound;
 }
@@ -551,6 +628,8 @@ IMPLEMENTATION(Include, "#include", true, NULL)
     return (*string == '\'') && !((*(string - 1) == '\\') && (*(string - 2) != '\\')) ? 1 : NSNotFound;
 }
 
+TERMINATOR_METHOD("'", '\\')
+
 - (NSString*) cleanContent {
     NSRange range = self.range;
     return _CleanEscapedString([self.text substringWithRange:NSMakeRange(range.location + 1, range.length - 2)]);
@@ -560,6 +639,10 @@ IMPLEMENTATION(Include, "#include", true, NULL)
 
 @implementation ParserNodeCString
 
++ (NSString*) prefixCharacters {
+    return @"\"";
+}
+
 + (NSUInteger) isMatchingPrefix:(const unichar*)string maxLength:(NSUInteger)maxLength {
     return (*string == '"') ? 1 : NSNotFound;
 }
@@ -568,6 +651,8 @@ IMPLEMENTATION(Include, "#include", true, NULL)
     return (*string == '"') && !((*(string - 1) == '\\') && (*(string - 2) != '\\')) ? 1 : NSNotFound;
 }
 
+TERMINATOR_METHOD("\"", '\\')
+
 - (NSString*) cleanContent {
     NSRange range = self.range;
     return _CleanEscapedString([self.text substringWithRange:NSMakeRange(range.location + 1, range.length - 2)]);
@@ -627,6 +712,10 @@ IMPLEMENTATION(TypeOf, "typeof", true, "(")
     return [NSSet setWithObject:[ParserNodeCConditionElse class]];
 }
 
++ (NSString*) prefixCharacters {
+    return [ParserNodeCConditionElse prefixCharacters];
+}
+
 + (NSUInteger) isMatchingPrefix:(const unichar*)string maxLength:(NSUInteger)maxLength { \
     NSUInteger length = [ParserNodeCConditionElse isMatchingPrefix:string maxLength:maxLength];
     if(length != NSNotFound) {
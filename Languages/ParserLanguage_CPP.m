@@ -78,166 +78,195 @@
     return [NSSet setWithObjects:@"cc", @"cp", @"cpp", nil];
 }
 
-- (ParserNode*) performSyntaxAnalysis:(NSUInteger)passIndex forNode:(ParserNode*)node textBuffer:(const unichar*)textBuffer topLevelLanguage:(ParserLanguage*)topLevelLanguage {
+static ParserNode* _AnalyzeBraces(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    ParserNode* previousNode = [node findPreviousSiblingIgnoringWhitespaceAndNewline];
     
-    if(passIndex == 0) {
-        if([node isKindOfClass:[ParserNodeBraces class]]) {
-            ParserNode* previousNode = [node findPreviousSiblingIgnoringWhitespaceAndNewline];
-            
-            // "catch() {}"
-            if([previousNode isKindOfClass:[ParserNodeParenthesis class]]) {
-                previousNode = [previousNode findPreviousSiblingIgnoringWhitespaceAndNewline];
-                if([previousNode isKindOfClass:[ParserNodeCPPCatch class]]) {
-                    _RearrangeNodesAsParentAndChildren(previousNode, node);
-                }
-            }
-            
-            // "try {}"
-            else if([previousNode isKindOfClass:[ParserNodeCPPTry class]]) {
-                _RearrangeNodesAsParentAndChildren(previousNode, node);
-            }
-            
-        } else if([node isKindOfClass:[ParserNodeParenthesis class]]) {
-            ParserNode* previousNode = [node findPreviousSiblingIgnoringWhitespaceAndNewline];
-            
-            // "throw()"
-            if([previousNode isKindOfClass:[ParserNodeCPPThrow class]]) {
-                _RearrangeNodesAsParentAndChildren(previousNode, node);
-            }
-            
-        } else if([node isKindOfClass:[ParserNodeCPPPrivate class]] || [node isKindOfClass:[ParserNodeCPPProtected class]] || [node isKindOfClass:[ParserNodeCPPPublic class]]) {
-            
-            // "private ..." "protected ..." "public ..."
-            ParserNode* nextNode = [node findNextSiblingIgnoringWhitespaceAndNewline];
-            if([nextNode isKindOfClass:[ParserNodeColon class]]) {
-                ParserNode* endNode = [node.parent.lastChild findPreviousSiblingIgnoringWhitespaceAndNewline]; //Last child is guaranted to be "}"
-                ParserNode* otherNode = [node findNextSiblingOfClass:[ParserNodeCPPPrivate class]];
-                if(otherNode && (otherNode.range.location < endNode.range.location)) {
-                    endNode = otherNode.previousSibling;
-                }
-                otherNode = [node findNextSiblingOfClass:[ParserNodeCPPProtected class]];
-                if(otherNode && (otherNode.range.location < endNode.range.location)) {
-                    endNode = otherNode.previousSibling;
-                }
-                otherNode = [node findNextSiblingOfClass:[ParserNodeCPPPublic class]];
-                if(otherNode && (otherNode.range.location < endNode.range.location)) {
-                    endNode = otherNode.previousSibling;
-                }
-                if([endNode isKindOfClass:[ParserNodeWhitespace class]] || [endNode isKindOfClass:[ParserNodeNewline class]]) {
-                    endNode = [endNode findPreviousSiblingIgnoringWhitespaceAndNewline];
-                }
-                _RearrangeNodesAsParentAndChildren(node, endNode);
-            }
-            
-        } else if([node isKindOfClass:[ParserNodeCPPNamespace class]]) {
-            
-            // "namespace {}"
-            ParserNode* nextNode = [node findNextSiblingIgnoringWhitespaceAndNewline];
-            if([nextNode isMemberOfClass:[ParserNodeText class]]) {
-                nextNode = [nextNode findNextSiblingIgnoringWhitespaceAndNewline];
-                if([nextNode isKindOfClass:[ParserNodeBraces class]]) {
-                    _RearrangeNodesAsParentAndChildren(node, nextNode);
-                }
-            }
-            
-        } else if([node isKindOfClass:[ParserNodeCPPClass class]]) {
-            
-            // "class {}"
-            ParserNode* bracesNode = [node findNextSiblingOfClass:[ParserNodeBraces class]];
-            ParserNode* semicolonNode = [node findNextSiblingOfClass:[ParserNodeSemicolon class]];
-            if(bracesNode && (!semicolonNode || ([node.parent indexOfChild:semicolonNode] > [node.parent indexOfChild:bracesNode]))) {
-                if(!semicolonNode) {
-                    _RearrangeNodesAsParentAndChildren(node, node.parent.lastChild);
-                } else {
-                    _RearrangeNodesAsParentAndChildren(node, semicolonNode);
-                }
-            }
-            
-        } else if([node isKindOfClass:[ParserNodeCPPNew class]] || [node isKindOfClass:[ParserNodeCPPDelete class]]) {
-            
-            // "new foo" "delete foo"
-            ParserNode* semicolonNode = [node findNextSiblingOfClass:[ParserNodeSemicolon class]];
-            if(semicolonNode) {
-                _RearrangeNodesAsParentAndChildren(node, semicolonNode);
-            }
-            
-        } else if([node isKindOfClass:[ParserNodeCPPTypeId class]]) {
-            
-            // "typeid()"
-            ParserNode* nextNode = [node findNextSiblingIgnoringWhitespaceAndNewline];
-            if([nextNode isKindOfClass:[ParserNodeParenthesis class]]) {
-                _RearrangeNodesAsParentAndChildren(node, nextNode);
-            }
-            
-        } else if([node isKindOfClass:[ParserNodeCPPVirtual class]]) {
-            
-            // "virtual foo bar()"
-            ParserNode* semicolonNode = [node findNextSiblingOfClass:[ParserNodeSemicolon class]];
-            if(semicolonNode) {
-                _RearrangeNodesAsParentAndChildren(node, semicolonNode);
-            }
-            
+    // "catch() {}"
+    if(IS_KIND(previousNode, Parenthesis)) {
+        previousNode = [previousNode findPreviousSiblingIgnoringWhitespaceAndNewline];
+        if(IS_KIND(previousNode, CPPCatch)) {
+            _RearrangeNodesAsParentAndChildren(previousNode, node);
         }
     }
     
-    if(passIndex == 1) {
-        
-        if([node isKindOfClass:[ParserNodeCFunctionCall class]]) {
-            
-            // "virtual foo bar()"
-            if([node.parent isKindOfClass:[ParserNodeCPPVirtual class]]) {
-                [node replaceWithNode:nil preserveChildren:YES];
-            }
-            
-            // "foo.bar()" "foo->bar()"
-            else {
-                ParserNode* previousNode1 = node.previousSibling;
-                if([previousNode1 isKindOfClass:[ParserNodeDot class]] || [previousNode1 isKindOfClass:[ParserNodeArrow class]]) {
-                    ParserNode* previousNode2 = previousNode1.previousSibling;
-                    if([previousNode2 isKindOfClass:[ParserNodeText class]]) {
-                        _AdoptNodesAsChildren(previousNode2, node);
-                        return [node replaceWithNodeOfClass:[ParserNodeCPPFunctionCall class] preserveChildren:YES];
-                    }
-                }
-            }
-            
+    // "try {}"
+    else if(IS_KIND(previousNode, CPPTry)) {
+        _RearrangeNodesAsParentAndChildren(previousNode, node);
+    }
+    
+    return node;
+}
+
+static ParserNode* _AnalyzeParenthesis(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    ParserNode* previousNode = [node findPreviousSiblingIgnoringWhitespaceAndNewline];
+    
+    // "throw()"
+    if(IS_KIND(previousNode, CPPThrow)) {
+        _RearrangeNodesAsParentAndChildren(previousNode, node);
+    }
+    
+    return node;
+}
+
+static ParserNode* _AnalyzeAccessSpecifier(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    // "private ..." "protected ..." "public ..."
+    ParserNode* nextNode = [node findNextSiblingIgnoringWhitespaceAndNewline];
+    if(IS_KIND(nextNode, Colon)) {
+        ParserNode* endNode = [node.parent.lastChild findPreviousSiblingIgnoringWhitespaceAndNewline]; //Last child is guaranted to be "}"
+        ParserNode* otherNode = [node findNextSiblingOfClass:[ParserNodeCPPPrivate class]];
+        if(otherNode && (otherNode.range.location < endNode.range.location)) {
+            endNode = otherNode.previousSibling;
         }
-        
-        else if([node isKindOfClass:[ParserNodeCFunctionDefinition class]] || [node isKindOfClass:[ParserNodeCFunctionPrototype class]]) {
-            
-            // "constructor() : foo_(bar) {}"
-            if([node.parent isKindOfClass:[ParserNodeCFunctionDefinition class]]) {
-                [node replaceWithNode:nil preserveChildren:YES];
-            }
-            
-            // "~destructor()" "foo::bar()"
-            else {
-                ParserNode* previousNode1 = node.previousSibling;
-                if([previousNode1 isKindOfClass:[ParserNodeTilde class]]) {
-                    _AdoptNodesAsChildren(previousNode1, node);
-                    return [node replaceWithNodeOfClass:[node class] preserveChildren:YES];
-                } else if([previousNode1 isKindOfClass:[ParserNodeDoubleSemicolon class]]) {
-                    ParserNode* previousNode2 = previousNode1.previousSibling;
-                    if([previousNode2 isKindOfClass:[ParserNodeText class]]) {
-                        _AdoptNodesAsChildren(previousNode2, node);
-                        return [node replaceWithNodeOfClass:[node class] preserveChildren:YES];
-                    }
-                }
+        otherNode = [node findNextSiblingOfClass:[ParserNodeCPPProtected class]];
+        if(otherNode && (otherNode.range.location < endNode.range.location)) {
+            endNode = otherNode.previousSibling;
+        }
+        otherNode = [node findNextSiblingOfClass:[ParserNodeCPPPublic class]];
+        if(otherNode && (otherNode.range.location < endNode.range.location)) {
+            endNode = otherNode.previousSibling;
+        }
+        if(IS_KIND(endNode, Whitespace) || IS_KIND(endNode, Newline)) {
+            endNode = [endNode findPreviousSiblingIgnoringWhitespaceAndNewline];
+        }
+        _RearrangeNodesAsParentAndChildren(node, endNode);
+    }
+    
+    return node;
+}
+
+static ParserNode* _AnalyzeNamespace(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    // "namespace {}"
+    ParserNode* nextNode = [node findNextSiblingIgnoringWhitespaceAndNewline];
+    if(IS_MEMBER_OF_KIND(nextNode, Text)) {
+        nextNode = [nextNode findNextSiblingIgnoringWhitespaceAndNewline];
+        if(IS_KIND(nextNode, Braces)) {
+            _RearrangeNodesAsParentAndChildren(node, nextNode);
+        }
+    }
+    
+    return node;
+}
+
+static ParserNode* _AnalyzeClass(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    // "class {}"
+    ParserNode* bracesNode = [node findNextSiblingOfClass:[ParserNodeBraces class]];
+    ParserNode* semicolonNode = [node findNextSiblingOfClass:[ParserNodeSemicolon class]];
+    if(bracesNode && (!semicolonNode || ([node.parent indexOfChild:semicolonNode] > [node.parent indexOfChild:bracesNode]))) {
+        if(!semicolonNode) {
+            _RearrangeNodesAsParentAndChildren(node, node.parent.lastChild);
+        } else {
+            _RearrangeNodesAsParentAndChildren(node, semicolonNode);
+        }
+    }
+    
+    return node;
+}
+
+static ParserNode* _AnalyzeNewOrDelete(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    // "new foo" "delete foo"
+    ParserNode* semicolonNode = [node findNextSiblingOfClass:[ParserNodeSemicolon class]];
+    if(semicolonNode) {
+        _RearrangeNodesAsParentAndChildren(node, semicolonNode);
+    }
+    
+    return node;
+}
+
+static ParserNode* _AnalyzeTypeId(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    // "typeid()"
+    ParserNode* nextNode = [node findNextSiblingIgnoringWhitespaceAndNewline];
+    if(IS_KIND(nextNode, Parenthesis)) {
+        _RearrangeNodesAsParentAndChildren(node, nextNode);
+    }
+    
+    return node;
+}
+
+static ParserNode* _AnalyzeVirtual(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    // "virtual foo bar()"
+    ParserNode* semicolonNode = [node findNextSiblingOfClass:[ParserNodeSemicolon class]];
+    if(semicolonNode) {
+        _RearrangeNodesAsParentAndChildren(node, semicolonNode);
+    }
+    
+    return node;
+}
+
+static ParserNode* _AnalyzeFunctionCall(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    // "virtual foo bar()"
+    if(IS_KIND(node.parent, CPPVirtual)) {
+        [node replaceWithNode:nil preserveChildren:YES];
+    }
+    
+    // "foo.bar()" "foo->bar()"
+    else {
+        ParserNode* previousNode1 = node.previousSibling;
+        if(IS_KIND(previousNode1, Dot) || IS_KIND(previousNode1, Arrow)) {
+            ParserNode* previousNode2 = previousNode1.previousSibling;
+            if(IS_KIND(previousNode2, Text)) {
+                _AdoptNodesAsChildren(previousNode2, node);
+                return [node replaceWithNodeOfClass:[ParserNodeCPPFunctionCall class] preserveChildren:YES];
             }
-            
         }
-        
     }
     
-    //FIXME: Add support for templates
+    return node;
+}
+
+static ParserNode* _AnalyzeFunction(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    // "constructor() : foo_(bar) {}"
+    if(IS_KIND(node.parent, CFunctionDefinition)) {
+        [node replaceWithNode:nil preserveChildren:YES];
+    }
+    
+    // "~destructor()" "foo::bar()"
+    else {
+        ParserNode* previousNode1 = node.previousSibling;
+        if(IS_KIND(previousNode1, Tilde)) {
+            _AdoptNodesAsChildren(previousNode1, node);
+            return [node replaceWithNodeOfClass:[node class] preserveChildren:YES];
+        } else if(IS_KIND(previousNode1, DoubleSemicolon)) {
+            ParserNode* previousNode2 = previousNode1.previousSibling;
+            if(IS_KIND(previousNode2, Text)) {
+                _AdoptNodesAsChildren(previousNode2, node);
+                return [node replaceWithNodeOfClass:[node class] preserveChildren:YES];
+            }
+        }
+    }
     
     return node;
 }
 
+//FIXME: Add support for templates
++ (const ParserSyntaxAnalysisRule*) languageSyntaxAnalysisRules {
+    static const ParserSyntaxAnalysisRule rules[] = {
+        {0, "ParserNodeBraces", _AnalyzeBraces},
+        {0, "ParserNodeParenthesis", _AnalyzeParenthesis},
+        {0, "ParserNodeCPPPrivate", _AnalyzeAccessSpecifier},
+        {0, "ParserNodeCPPProtected", _AnalyzeAccessSpecifier},
+        {0, "ParserNodeCPPPublic", _AnalyzeAccessSpecifier},
+        {0, "ParserNodeCPPNamespace", _AnalyzeNamespace},
+        {0, "ParserNodeCPPClass", _AnalyzeClass},
+        {0, "ParserNodeCPPNew", _AnalyzeNewOrDelete},
+        {0, "ParserNodeCPPDelete", _AnalyzeNewOrDelete},
+        {0, "ParserNodeCPPTypeId", _AnalyzeTypeId},
+        {0, "ParserNodeCPPVirtual", _AnalyzeVirtual},
+        {1, "ParserNodeCFunctionCall", _AnalyzeFunctionCall},
+        {1, "ParserNodeCFunctionDefinition", _AnalyzeFunction},
+        {1, "ParserNodeCFunctionPrototype", _AnalyzeFunction},
+        {0, NULL, NULL}
+    };
+    return rules;
+}
+
 @end
 
 @implementation ParserNodeCPPComment
 
++ (NSString*) prefixCharacters {
+    return @"/";
+}
+
 + (NSUInteger) isMatchingPrefix:(const unichar*)string maxLength:(NSUInteger)maxLength {
     return (string[0] == '/') && (string[1] == '/') ? 2 : NSNotFound;
 }
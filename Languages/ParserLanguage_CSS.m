@@ -60,10 +60,9 @@
     return [NSSet setWithObject:@"css"];
 }
 
-- (ParserNode*) performSyntaxAnalysis:(NSUInteger)passIndex forNode:(ParserNode*)node textBuffer:(const unichar*)textBuffer topLevelLanguage:(ParserLanguage*)topLevelLanguage {
-    
-    if([node isMemberOfClass:[ParserNodeText class]] && ![node.parent isKindOfClass:[ParserNodeCSSAtRule class]] && ![node.parent isKindOfClass:[ParserNodeCSSPropertyValue class]]) {
-        if(![node.parent isKindOfClass:[ParserNodeCSSRule class]]) {
+static ParserNode* _AnalyzeText(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    if(IS_MEMBER_OF_KIND(node, Text) && !IS_KIND(node.parent, CSSAtRule) && !IS_KIND(node.parent, CSSPropertyValue)) {
+        if(!IS_KIND(node.parent, CSSRule)) {
             ParserNode* endNode = [node findNextSiblingOfClass:[ParserNodeBraces class]];
             if(endNode) {
                 ParserNode* newNode = [[ParserNodeCSSRule alloc] initWithText:node.text range:NSMakeRange(node.range.location, 0)];
@@ -74,32 +73,33 @@
             }
         }
         
-        if(![node.parent isKindOfClass:[ParserNodeCSSSelector class]] && ![node.parent isKindOfClass:[ParserNodeBraces class]]) {
+        if(!IS_KIND(node.parent, CSSSelector) && !IS_KIND(node.parent, Braces)) {
             static NSSet* set = nil;
             if(set == nil)
                 set = [[NSSet alloc] initWithObjects:[ParserNodeWhitespace class], [ParserNodeNewline class], [ParserNodeComma class], [ParserNodeBraces class], nil];
             ParserNode* nextNode = [[node findNextSiblingOfAnyClass:set] previousSibling];
             if(nextNode) {
                 ParserNode* newNode = [[ParserNodeCSSSelector alloc] initWithText:node.text range:NSMakeRange(node.range.location, nextNode.range.location + nextNode.range.length - node.range.location)];
-                newNode.lines = NSMakeRange(node.lines.location, nextNode.lines.location + nextNode.lines.length - node.lines.location);
                 [node insertPreviousSibling:newNode];
                 [newNode release];
-                while(1) {
-                    ParserNode* siblingNode = node.nextSibling;
-                    [node removeFromParent];
-                    if(node == nextNode) {
-                        break;
-                    }
-                    node = siblingNode;
-                }
+                ParserNode* parent = node.parent;
+                NSUInteger start = [parent indexOfChild:node];
+                _MoveChildren(parent, NSMakeRange(start, [parent indexOfChild:nextNode] + 1 - start), nil, 0);
+                node = nextNode;
             }
         }
-    } else if([node isKindOfClass:[ParserNodeColon class]] && [node.parent isKindOfClass:[ParserNodeBraces class]]) {
+    }
+    
+    return node;
+}
+
+static ParserNode* _AnalyzeColon(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    if(IS_KIND(node.parent, Braces)) {
         ParserNode* name = [node findPreviousSiblingIgnoringWhitespaceAndNewline];
         ParserNode* startNode = [node findNextSiblingIgnoringWhitespaceAndNewline];
         ParserNode* endNode = [node findNextSiblingOfClass:[ParserNodeSemicolon class]];
         endNode = [(endNode ? endNode : node.parent.lastChild) findPreviousSiblingIgnoringWhitespaceAndNewline];
-        if([name isKindOfClass:[ParserNodeText class]] && startNode) {
+        if(IS_KIND(name, Text) && startNode) {
             [name replaceWithNodeOfClass:[ParserNodeCSSPropertyName class] preserveChildren:NO];
             
             ParserNode* newNode = [[ParserNodeCSSPropertyValue alloc] initWithText:startNode.text range:NSMakeRange(startNode.range.location, 0)];
@@ -113,10 +113,23 @@
     return node;
 }
 
++ (const ParserSyntaxAnalysisRule*) languageSyntaxAnalysisRules {
+    static const ParserSyntaxAnalysisRule rules[] = {
+        {0, "ParserNodeColon", _AnalyzeColon},
+        {0, "ParserNodeText", _AnalyzeText},
+        {0, NULL, NULL}
+    };
+    return rules;
+}
+
 @end
 
 @implementation ParserNodeCSSString
 
++ (NSString*) prefixCharacters {
+    return @"\"'";
+}
+
 + (NSUInteger) isMatchingPrefix:(const unichar*)string maxLength:(NSUInteger)maxLength {
     if((*string == '"') || (*string == '\'')) {
         unichar character = *string;
@@ -149,6 +162,10 @@
 
 @implementation ParserNodeCSSComment
 
++ (NSString*) prefixCharacters {
+    return @"/";
+}
+
 + (NSUInteger) isMatchingPrefix:(const unichar*)string maxLength:(NSUInteger)maxLength {
     return (string[0] == '/') && (string[1] == '*') ? 2 : NSNotFound;
 }
@@ -157,6 +174,8 @@
     return (string[0] == '*') && (string[1] == '/') ? 2 : NSNotFound;
 }
 
+TERMINATOR_METHOD("*/", 0)
+
 - (NSString*) cleanContent {
     NSRange range = self.range;
     return [self.text substringWithRange:NSMakeRange(range.location + 2, range.length - 4)];
@@ -170,6 +189,10 @@
     return NO;
 }
 
++ (NSString*) prefixCharacters {
+    return @"@";
+}
+
 + (NSUInteger) isMatchingPrefix:(const unichar*)string maxLength:(NSUInteger)maxLength {
     if(*string == '@') {
         NSUInteger length = 1;
@@ -220,6 +243,10 @@
 
 @implementation ParserNodeCSSEscapedCharacter
 
++ (NSString*) prefixCharacters {
+    return @"\\";
+}
+
 + (NSUInteger) isMatchingPrefix:(const unichar*)string maxLength:(NSUInteger)maxLength {
     if((maxLength >= 2) && (*string == '\\')) {
         ++string;
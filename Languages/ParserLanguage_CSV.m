@@ -19,6 +19,14 @@
 #import "Parser_Internal.h"
 #import "ParserLanguage_CSV.h"
 
+#define kParallelMinimumLength (1024 * 1024)
+#define kParallelMinimumChunkLength (256 * 1024)
+
+typedef struct {
+    NSRange range;
+    ParserNodeRoot* root;
+} CSVChunk;
+
 @interface ParserLanguageCSV : ParserLanguage
 @end
 
@@ -37,6 +45,10 @@
     return classes;
 }
 
++ (BOOL) languageAllowsReparseBoundary:(Class)nodeClass {
+    return NO; //An unterminated quoted field runs over the following records which a record parsed on its own cannot tell
+}
+
 - (NSString*) name {
     return @"CSV";
 }
@@ -45,12 +57,97 @@
     return [NSSet setWithObject:@"csv"];
 }
 
-- (ParserNode*) performSyntaxAnalysis:(NSUInteger)passIndex forNode:(ParserNode*)node textBuffer:(const unichar*)textBuffer topLevelLanguage:(ParserLanguage*)topLevelLanguage {
+- (void) _parseChunkInBackground:(NSArray*)arguments {
+    NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+    CSVChunk* chunk = [[arguments objectAtIndex:0] pointerValue];
+    NSString* text = [arguments objectAtIndex:1];
+    const unichar* textBuffer = [[arguments objectAtIndex:2] pointerValue];
+    BOOL syntaxAnalysis = [[arguments objectAtIndex:3] boolValue];
+    NSConditionLock* lock = [[arguments objectAtIndex:4] retain];
+    
+    ParserArena* arena = [ParserLanguage usesArenaAllocation] ? _ParserArenaCreate(text) : NULL; //Arenas are not thread-safe so each chunk gets its own
+    _ParserArenaSetCurrent(arena);
+    chunk->root = [[super parseText:text range:chunk->range textBuffer:textBuffer syntaxAnalysis:syntaxAnalysis] retain];
+    [pool drain];
+    _ParserArenaSetCurrent(NULL);
+    if(arena) {
+        _ParserArenaRelease(arena);
+    }
+    
+    [lock lock]; //Nothing of the chunk must be touched from this thread past this point
+    [lock unlockWithCondition:([lock condition] + 1)];
+    [lock release];
+}
+
+/* Large texts are split at record boundaries and the chunks are parsed in parallel before being merged back under a single root */
+- (ParserNodeRoot*) parseText:(NSString*)text range:(NSRange)range textBuffer:(const unichar*)textBuffer syntaxAnalysis:(BOOL)syntaxAnalysis {
+    NSUInteger count = MIN([[NSProcessInfo processInfo] activeProcessorCount], range.length / kParallelMinimumChunkLength);
+    if((range.length < kParallelMinimumLength) || (count < 2)) {
+        return [super parseText:text range:range textBuffer:textBuffer syntaxAnalysis:syntaxAnalysis];
+    }
+    
+    //Find newlines outside of quotes closest to the ideal chunk boundaries
+    CSVChunk* chunks = calloc(count, sizeof(CSVChunk));
+    NSUInteger chunkCount = 0;
+    NSUInteger start = range.location;
+    NSUInteger end = range.location + range.length;
+    BOOL inQuotes = NO;
+    for(NSUInteger i = range.location; (i < end) && (chunkCount < count - 1); ++i) {
+        unichar character = textBuffer[i];
+        if(character == '"') {
+            inQuotes = !inQuotes;
+        } else if(IsNewline(character) && !inQuotes && (i >= range.location + (chunkCount + 1) * (range.length / count))) {
+            if((character == '\r') && (textBuffer[i + 1] == '\n')) {
+                ++i;
+            }
+            if(i + 1 < end) {
+                chunks[chunkCount++].range = NSMakeRange(start, i + 1 - start);
+                start = i + 1;
+            }
+        }
+    }
+    chunks[chunkCount++].range = NSMakeRange(start, end - start);
     
-    if(![node isKindOfClass:[ParserNodeRoot class]] && ![node.parent isKindOfClass:[ParserNodeCSVRecord class]]) {
+    //Make sure lazily computed state is ready before accessing it from multiple threads
+    [self allLanguageDependencies];
+    [self nodeClasses];
+    
+    NSConditionLock* lock = [[NSConditionLock alloc] initWithCondition:0];
+    for(NSUInteger i = 1; i < chunkCount; ++i) {
+        NSArray* arguments = [NSArray arrayWithObjects:[NSValue valueWithPointer:&chunks[i]], text, [NSValue valueWithPointer:textBuffer], [NSNumber numberWithBool:syntaxAnalysis], lock, nil];
+        [NSThread detachNewThreadSelector:@selector(_parseChunkInBackground:) toTarget:self withObject:arguments];
+    }
+    chunks[0].root = [[super parseText:text range:chunks[0].range textBuffer:textBuffer syntaxAnalysis:syntaxAnalysis] retain];
+    [lock lockWhenCondition:(chunkCount - 1)];
+    [lock unlock];
+    [lock release];
+    
+    ParserNodeRoot* rootNode = [[[ParserNodeRoot alloc] initWithText:text range:range] autorelease];
+    rootNode.language = self;
+    for(NSUInteger i = 0; i < chunkCount; ++i) {
+        if(chunks[i].root == nil) {
+            rootNode = nil;
+        }
+    }
+    for(NSUInteger i = 0; i < chunkCount; ++i) {
+        if(rootNode) {
+            _MoveChildren(chunks[i].root, NSMakeRange(0, chunks[i].root.children.count), rootNode, rootNode.children.count);
+        }
+        [chunks[i].root release];
+    }
+    free(chunks);
+    if(rootNode) {
+        _MarkNodeUnmodified(rootNode, text);
+    }
+    
+    return rootNode;
+}
+
+static ParserNode* _AnalyzeNode(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    if(!IS_KIND(node, Root) && !IS_KIND(node.parent, CSVRecord)) {
         ParserNode* endNode = node;
         while(endNode.nextSibling) {
-            if([endNode isKindOfClass:[ParserNodeNewline class]]) {
+            if(IS_KIND(endNode, Newline)) {
                 break;
             }
             endNode = endNode.nextSibling;
@@ -68,6 +165,14 @@
     return node;
 }
 
++ (const ParserSyntaxAnalysisRule*) languageSyntaxAnalysisRules {
+    static const ParserSyntaxAnalysisRule rules[] = {
+        {0, "ParserNode", _AnalyzeNode},
+        {0, NULL, NULL}
+    };
+    return rules;
+}
+
 @end
 
 @implementation ParserNodeCSVField
@@ -108,4 +213,9 @@
 @end
 
 @implementation ParserNodeCSVRecord
+
++ (BOOL) isReparseBoundary {
+    return YES;
+}
+
 @end
@@ -22,6 +22,300 @@
 @interface ParserLanguageHTML : ParserLanguageSGML
 @end
 
+typedef struct {
+    const char* name;
+    unichar character;
+} HTMLEntity;
+
+/* Perfect hash of the HTML 4 entities (http://www.w3.org/TR/REC-html40/sgml/entities.html) generated offline with the hash and displace algorithm: the displacement of the bucket of a name seeds the hash which gives its index in the table */
+#define kEntityBuckets 64
+#define kEntityCount 253
+#define kEntityMaxLength 8
+
+static const uint32_t _entityDisplacements[kEntityBuckets] = {
+    43, 14, 4, 4, 2, 78, 136, 3, 2, 127, 1, 49, 6, 527, 188, 26,
+    39, 1, 2, 10, 37, 1, 4, 69, 5, 4, 14, 50, 11, 119, 273, 241,
+    527, 91, 9, 608, 980, 1497, 22, 1, 8, 59, 12, 98, 3584, 34, 8, 11047,
+    146, 86, 49, 18, 13, 1340, 7989, 75, 13, 0, 2, 132, 19, 44, 247, 570,
+};
+
+static const HTMLEntity _entities[kEntityCount] = {
+    {"omega", 0x03C9},
+    {"darr", 0x2193},
+    {"Alpha", 0x0391},
+    {"bdquo", 0x201E},
+    {"empty", 0x2205},
+    {"spades", 0x2660},
+    {"brvbar", 0x00A6},
+    {"iota", 0x03B9},
+    {"Ugrave", 0x00D9},
+    {"nabla", 0x2207},
+    {"fnof", 0x0192},
+    {"ordm", 0x00BA},
+    {"asymp", 0x2248},
+    {"sum", 0x2211},
+    {"ETH", 0x00D0},
+    {"epsilon", 0x03B5},
+    {"rlm", 0x200F},
+    {"laquo", 0x00AB},
+    {"oslash", 0x00F8},
+    {"Eta", 0x0397},
+    {"plusmn", 0x00B1},
+    {"rho", 0x03C1},
+    {"Oslash", 0x00D8},
+    {"ni", 0x220B},
+    {"xi", 0x03BE},
+    {"nu", 0x03BD},
+    {"sub", 0x2282},
+    {"Igrave", 0x00CC},
+    {"THORN", 0x00DE},
+    {"exist", 0x2203},
+    {"reg", 0x00AE},
+    {"oline", 0x203E},
+    {"psi", 0x03C8},
+    {"cap", 0x2229},
+    {"piv", 0x03D6},
+    {"egrave", 0x00E8},
+    {"lceil", 0x2308},
+    {"uuml", 0x00FC},
+    {"part", 0x2202},
+    {"apos", 0x0027},
+    {"Prime", 0x2033},
+    {"lfloor", 0x230A},
+    {"deg", 0x00B0},
+    {"lsquo", 0x2018},
+    {"delta", 0x03B4},
+    {"times", 0x00D7},
+    {"Ecirc", 0x00CA},
+    {"not", 0x00AC},
+    {"int", 0x222B},
+    {"sup3", 0x00B3},
+    {"oacute", 0x00F3},
+    {"phi", 0x03C6},
+    {"rfloor", 0x230B},
+    {"crarr", 0x21B5},
+    {"frasl", 0x2044},
+    {"Epsilon", 0x0395},
+    {"loz", 0x25CA},
+    {"rang", 0x232A},
+    {"iuml", 0x00EF},
+    {"iquest", 0x00BF},
+    {"gt", 0x003E},
+    {"Gamma", 0x0393},
+    {"agrave", 0x00E0},
+    {"Delta", 0x0394},
+    {"prime", 0x2032},
+    {"Scaron", 0x0160},
+    {"hellip", 0x2026},
+    {"ndash", 0x2013},
+    {"cup", 0x222A},
+    {"Agrave", 0x00C0},
+    {"aelig", 0x00E6},
+    {"Psi", 0x03A8},
+    {"thinsp", 0x2009},
+    {"tilde", 0x02DC},
+    {"ne", 0x2260},
+    {"chi", 0x03C7},
+    {"pi", 0x03C0},
+    {"Theta", 0x0398},
+    {"upsilon", 0x03C5},
+    {"Ocirc", 0x00D4},
+    {"mdash", 0x2014},
+    {"Uuml", 0x00DC},
+    {"cent", 0x00A2},
+    {"supe", 0x2287},
+    {"tau", 0x03C4},
+    {"nbsp", 0x00A0},
+    {"iexcl", 0x00A1},
+    {"dArr", 0x21D3},
+    {"sbquo", 0x201A},
+    {"uArr", 0x21D1},
+    {"acute", 0x00B4},
+    {"kappa", 0x03BA},
+    {"alefsym", 0x2135},
+    {"copy", 0x00A9},
+    {"shy", 0x00AD},
+    {"uacute", 0x00FA},
+    {"thetasym", 0x03D1},
+    {"zwj", 0x200D},
+    {"Yacute", 0x00DD},
+    {"diams", 0x2666},
+    {"Otilde", 0x00D5},
+    {"lt", 0x003C},
+    {"bull", 0x2022},
+    {"sim", 0x223C},
+    {"frac14", 0x00BC},
+    {"eacute", 0x00E9},
+    {"lambda", 0x03BB},
+    {"frac12", 0x00BD},
+    {"sup2", 0x00B2},
+    {"icirc", 0x00EE},
+    {"ocirc", 0x00F4},
+    {"amp", 0x0026},
+    {"uarr", 0x2191},
+    {"isin", 0x2208},
+    {"uml", 0x00A8},
+    {"weierp", 0x2118},
+    {"radic", 0x221A},
+    {"Phi", 0x03A6},
+    {"rsquo", 0x2019},
+    {"macr", 0x00AF},
+    {"sube", 0x2286},
+    {"Xi", 0x039E},
+    {"le", 0x2264},
+    {"image", 0x2111},
+    {"Ucirc", 0x00DB},
+    {"mu", 0x03BC},
+    {"Acirc", 0x00C2},
+    {"pound", 0x00A3},
+    {"there4", 0x2234},
+    {"Atilde", 0x00C3},
+    {"szlig", 0x00DF},
+    {"acirc", 0x00E2},
+    {"theta", 0x03B8},
+    {"lrm", 0x200E},
+    {"OElig", 0x0152},
+    {"Icirc", 0x00CE},
+    {"Ccedil", 0x00C7},
+    {"iacute", 0x00ED},
+    {"Uacute", 0x00DA},
+    {"infin", 0x221E},
+    {"dagger", 0x2020},
+    {"ldquo", 0x201C},
+    {"Sigma", 0x03A3},
+    {"cong", 0x2245},
+    {"ensp", 0x2002},
+    {"euml", 0x00EB},
+    {"upsih", 0x03D2},
+    {"Ntilde", 0x00D1},
+    {"sup1", 0x00B9},
+    {"yuml", 0x00FF},
+    {"divide", 0x00F7},
+    {"Tau", 0x03A4},
+    {"or", 0x2228},
+    {"euro", 0x20AC},
+    {"Omicron", 0x039F},
+    {"curren", 0x00A4},
+    {"ntilde", 0x00F1},
+    {"otimes", 0x2297},
+    {"larr", 0x2190},
+    {"Dagger", 0x2021},
+    {"zeta", 0x03B6},
+    {"Beta", 0x0392},
+    {"AElig", 0x00C6},
+    {"aacute", 0x00E1},
+    {"sigmaf", 0x03C2},
+    {"Iuml", 0x00CF},
+    {"ang", 0x2220},
+    {"Yuml", 0x0178},
+    {"ucirc", 0x00FB},
+    {"Upsilon", 0x03A5},
+    {"rdquo", 0x201D},
+    {"lArr", 0x21D0},
+    {"sdot", 0x22C5},
+    {"Pi", 0x03A0},
+    {"sect", 0x00A7},
+    {"ge", 0x2265},
+    {"clubs", 0x2663},
+    {"circ", 0x02C6},
+    {"micro", 0x00B5},
+    {"oplus", 0x2295},
+    {"notin", 0x2209},
+    {"Nu", 0x039D},
+    {"eth", 0x00F0},
+    {"minus", 0x2212},
+    {"yen", 0x00A5},
+    {"eta", 0x03B7},
+    {"ordf", 0x00AA},
+    {"lowast", 0x2217},
+    {"rceil", 0x2309},
+    {"aring", 0x00E5},
+    {"middot", 0x00B7},
+    {"sigma", 0x03C3},
+    {"otilde", 0x00F5},
+    {"para", 0x00B6},
+    {"omicron", 0x03BF},
+    {"Iota", 0x0399},
+    {"ugrave", 0x00F9},
+    {"Iacute", 0x00CD},
+    {"cedil", 0x00B8},
+    {"oelig", 0x0153},
+    {"real", 0x211C},
+    {"Rho", 0x03A1},
+    {"Aring", 0x00C5},
+    {"Ograve", 0x00D2},
+    {"zwnj", 0x200C},
+    {"Oacute", 0x00D3},
+    {"alpha", 0x03B1},
+    {"sup", 0x2283},
+    {"rarr", 0x2192},
+    {"lsaquo", 0x2039},
+    {"yacute", 0x00FD},
+    {"igrave", 0x00EC},
+    {"scaron", 0x0161},
+    {"Auml", 0x00C4},
+    {"atilde", 0x00E3},
+    {"Lambda", 0x039B},
+    {"trade", 0x2122},
+    {"ccedil", 0x00E7},
+    {"hArr", 0x21D4},
+    {"ecirc", 0x00EA},
+    {"Omega", 0x03A9},
+    {"Euml", 0x00CB},
+    {"Aacute", 0x00C1},
+    {"raquo", 0x00BB},
+    {"perp", 0x22A5},
+    {"rsaquo", 0x203A},
+    {"Mu", 0x039C},
+    {"quot", 0x0022},
+    {"Egrave", 0x00C8},
+    {"prod", 0x220F},
+    {"hearts", 0x2665},
+    {"prop", 0x221D},
+    {"and", 0x2227},
+    {"harr", 0x2194},
+    {"lang", 0x2329},
+    {"ograve", 0x00F2},
+    {"thorn", 0x00FE},
+    {"rArr", 0x21D2},
+    {"permil", 0x2030},
+    {"gamma", 0x03B3},
+    {"equiv", 0x2261},
+    {"beta", 0x03B2},
+    {"forall", 0x2200},
+    {"Zeta", 0x0396},
+    {"Kappa", 0x039A},
+    {"Eacute", 0x00C9},
+    {"ouml", 0x00F6},
+    {"frac34", 0x00BE},
+    {"emsp", 0x2003},
+    {"Ouml", 0x00D6},
+    {"nsub", 0x2284},
+    {"auml", 0x00E4},
+    {"Chi", 0x03A7},
+};
+
+static inline uint32_t _HashEntityName(const unichar* name, NSUInteger length, uint32_t seed) {
+    uint32_t hash = 2166136261U ^ seed; //FNV-1a
+    for(NSUInteger i = 0; i < length; ++i) {
+        hash = (hash ^ name[i]) * 16777619U;
+    }
+    return hash;
+}
+
+static unichar _LookupEntity(const unichar* name, NSUInteger length) {
+    if(length > kEntityMaxLength) {
+        return 0;
+    }
+    const HTMLEntity* entity = &_entities[_HashEntityName(name, length, _entityDisplacements[_HashEntityName(name, length, 0) % kEntityBuckets]) % kEntityCount];
+    for(NSUInteger i = 0; i < length; ++i) {
+        if(entity->name[i] != name[i]) {
+            return 0;
+        }
+    }
+    return entity->name[length] ? 0 : entity->character;
+}
+
 @implementation ParserLanguageHTML
 
 /* WARNING: Keep in sync with ParserLanguage_SGML */
@@ -42,270 +336,7 @@
 }
 
 + (NSString*) stringWithReplacedEntities:(NSString*)string {
-    static NSDictionary* entities = nil;
-    if(entities == nil) {
-        entities = [[NSDictionary alloc] initWithObjectsAndKeys:
-            @"&quot;", @"\x22",
-            @"&amp;", @"\x26",
-            @"&apos;", @"\x27",
-            @"&lt;", @"\x3C",
-            @"&gt;", @"\x3E",
-            
-            @"&nbsp;", @"\u00A0",
-            @"&iexcl;", @"\u00A1",
-            @"&cent;", @"\u00A2",
-            @"&pound;", @"\u00A3",
-            @"&curren;", @"\u00A4",
-            @"&yen;", @"\u00A5",
-            @"&brvbar;", @"\u00A6",
-            @"&sect;", @"\u00A7",
-            @"&uml;", @"\u00A8",
-            @"&copy;", @"\u00A9",
-            @"&ordf;", @"\u00AA",
-            @"&laquo;", @"\u00AB",
-            @"&not;", @"\u00AC",
-            @"&shy;", @"\u00AD",
-            @"&reg;", @"\u00AE",
-            @"&macr;", @"\u00AF",
-            @"&deg;", @"\u00B0",
-            @"&plusmn;", @"\u00B1",
-            @"&sup2;", @"\u00B2",
-            @"&sup3;", @"\u00B3",
-            @"&acute;", @"\u00B4",
-            @"&micro;", @"\u00B5",
-            @"&para;", @"\u00B6",
-            @"&middot;", @"\u00B7",
-            @"&cedil;", @"\u00B8",
-            @"&sup1;", @"\u00B9",
-            @"&ordm;", @"\u00BA",
-            @"&raquo;", @"\u00BB",
-            @"&frac14;", @"\u00BC",
-            @"&frac12;", @"\u00BD",
-            @"&frac34;", @"\u00BE",
-            @"&iquest;", @"\u00BF",
-            @"&Agrave;", @"\u00C0",
-            @"&Aacute;", @"\u00C1",
-            @"&Acirc;", @"\u00C2",
-            @"&Atilde;", @"\u00C3",
-            @"&Auml;", @"\u00C4",
-            @"&Aring;", @"\u00C5",
-            @"&AElig;", @"\u00C6",
-            @"&Ccedil;", @"\u00C7",
-            @"&Egrave;", @"\u00C8",
-            @"&Eacute;", @"\u00C9",
-            @"&Ecirc;", @"\u00CA",
-            @"&Euml;", @"\u00CB",
-            @"&Igrave;", @"\u00CC",
-            @"&Iacute;", @"\u00CD",
-            @"&Icirc;", @"\u00CE",
-            @"&Iuml;", @"\u00CF",
-            @"&ETH;", @"\u00D0",
-            @"&Ntilde;", @"\u00D1",
-            @"&Ograve;", @"\u00D2",
-            @"&Oacute;", @"\u00D3",
-            @"&Ocirc;", @"\u00D4",
-            @"&Otilde;", @"\u00D5",
-            @"&Ouml;", @"\u00D6",
-            @"&times;", @"\u00D7",
-            @"&Oslash;", @"\u00D8",
-            @"&Ugrave;", @"\u00D9",
-            @"&Uacute;", @"\u00DA",
-            @"&Ucirc;", @"\u00DB",
-            @"&Uuml;", @"\u00DC",
-            @"&Yacute;", @"\u00DD",
-            @"&THORN;", @"\u00DE",
-            @"&szlig;", @"\u00DF",
-            @"&agrave;", @"\u00E0",
-            @"&aacute;", @"\u00E1",
-            @"&acirc;", @"\u00E2",
-            @"&atilde;", @"\u00E3",
-            @"&auml;", @"\u00E4",
-            @"&aring;", @"\u00E5",
-            @"&aelig;", @"\u00E6",
-            @"&ccedil;", @"\u00E7",
-            @"&egrave;", @"\u00E8",
-            @"&eacute;", @"\u00E9",
-            @"&ecirc;", @"\u00EA",
-            @"&euml;", @"\u00EB",
-            @"&igrave;", @"\u00EC",
-            @"&iacute;", @"\u00ED",
-            @"&icirc;", @"\u00EE",
-            @"&iuml;", @"\u00EF",
-            @"&eth;", @"\u00F0",
-            @"&ntilde;", @"\u00F1",
-            @"&ograve;", @"\u00F2",
-            @"&oacute;", @"\u00F3",
-            @"&ocirc;", @"\u00F4",
-            @"&otilde;", @"\u00F5",
-            @"&ouml;", @"\u00F6",
-            @"&divide;", @"\u00F7",
-            @"&oslash;", @"\u00F8",
-            @"&ugrave;", @"\u00F9",
-            @"&uacute;", @"\u00FA",
-            @"&ucirc;", @"\u00FB",
-            @"&uuml;", @"\u00FC",
-            @"&yacute;", @"\u00FD",
-            @"&thorn;", @"\u00FE",
-            @"&yuml;", @"\u00FF",
-            @"&OElig;", @"\u0152",
-            @"&oelig;", @"\u0153",
-            @"&Scaron;", @"\u0160",
-            @"&scaron;", @"\u0161",
-            @"&Yuml;", @"\u0178",
-            @"&fnof;", @"\u0192",
-            @"&circ;", @"\u02C6",
-            @"&tilde;", @"\u02DC",
-            @"&Alpha;", @"\u0391",
-            @"&Beta;", @"\u0392",
-            @"&Gamma;", @"\u0393",
-            @"&Delta;", @"\u0394",
-            @"&Epsilon;", @"\u0395",
-            @"&Zeta;", @"\u0396",
-            @"&Eta;", @"\u0397",
-            @"&Theta;", @"\u0398",
-            @"&Iota;", @"\u0399",
-            @"&Kappa;", @"\u039A",
-            @"&Lambda;", @"\u039B",
-            @"&Mu;", @"\u039C",
-            @"&Nu;", @"\u039D",
-            @"&Xi;", @"\u039E",
-            @"&Omicron;", @"\u039F",
-            @"&Pi;", @"\u03A0",
-            @"&Rho;", @"\u03A1",
-            @"&Sigma;", @"\u03A3",
-            @"&Tau;", @"\u03A4",
-            @"&Upsilon;", @"\u03A5",
-            @"&Phi;", @"\u03A6",
-            @"&Chi;", @"\u03A7",
-            @"&Psi;", @"\u03A8",
-            @"&Omega;", @"\u03A9",
-            @"&alpha;", @"\u03B1",
-            @"&beta;", @"\u03B2",
-            @"&gamma;", @"\u03B3",
-            @"&delta;", @"\u03B4",
-            @"&epsilon;", @"\u03B5",
-            @"&zeta;", @"\u03B6",
-            @"&eta;", @"\u03B7",
-            @"&theta;", @"\u03B8",
-            @"&iota;", @"\u03B9",
-            @"&kappa;", @"\u03BA",
-            @"&lambda;", @"\u03BB",
-            @"&mu;", @"\u03BC",
-            @"&nu;", @"\u03BD",
-            @"&xi;", @"\u03BE",
-            @"&omicron;", @"\u03BF",
-            @"&pi;", @"\u03C0",
-            @"&rho;", @"\u03C1",
-            @"&sigmaf;", @"\u03C2",
-            @"&sigma;", @"\u03C3",
-            @"&tau;", @"\u03C4",
-            @"&upsilon;", @"\u03C5",
-            @"&phi;", @"\u03C6",
-            @"&chi;", @"\u03C7",
-            @"&psi;", @"\u03C8",
-            @"&omega;", @"\u03C9",
-            @"&thetasym;", @"\u03D1",
-            @"&upsih;", @"\u03D2",
-            @"&piv;", @"\u03D6",
-            @"&ensp;", @"\u2002",
-            @"&emsp;", @"\u2003",
-            @"&thinsp;", @"\u2009",
-            @"&zwnj;", @"\u200C",
-            @"&zwj;", @"\u200D",
-            @"&lrm;", @"\u200E",
-            @"&rlm;", @"\u200F",
-            @"&ndash;", @"\u2013",
-            @"&mdash;", @"\u2014",
-            @"&lsquo;", @"\u2018",
-            @"&rsquo;", @"\u2019",
-            @"&sbquo;", @"\u201A",
-            @"&ldquo;", @"\u201C",
-            @"&rdquo;", @"\u201D",
-            @"&bdquo;", @"\u201E",
-            @"&dagger;", @"\u2020",
-            @"&Dagger;", @"\u2021",
-            @"&bull;", @"\u2022",
-            @"&hellip;", @"\u2026",
-            @"&permil;", @"\u2030",
-            @"&prime;", @"\u2032",
-            @"&Prime;", @"\u2033",
-            @"&lsaquo;", @"\u2039",
-            @"&rsaquo;", @"\u203A",
-            @"&oline;", @"\u203E",
-            @"&frasl;", @"\u2044",
-            @"&euro;", @"\u20AC",
-            @"&image;", @"\u2111",
-            @"&weierp;", @"\u2118",
-            @"&real;", @"\u211C",
-            @"&trade;", @"\u2122",
-            @"&alefsym;", @"\u2135",
-            @"&larr;", @"\u2190",
-            @"&uarr;", @"\u2191",
-            @"&rarr;", @"\u2192",
-            @"&darr;", @"\u2193",
-            @"&harr;", @"\u2194",
-            @"&crarr;", @"\u21B5",
-            @"&lArr;", @"\u21D0",
-            @"&uArr;", @"\u21D1",
-            @"&rArr;", @"\u21D2",
-            @"&dArr;", @"\u21D3",
-            @"&hArr;", @"\u21D4",
-            @"&forall;", @"\u2200",
-            @"&part;", @"\u2202",
-            @"&exist;", @"\u2203",
-            @"&empty;", @"\u2205",
-            @"&nabla;", @"\u2207",
-            @"&isin;", @"\u2208",
-            @"&notin;", @"\u2209",
-            @"&ni;", @"\u220B",
-            @"&prod;", @"\u220F",
-            @"&sum;", @"\u2211",
-            @"&minus;", @"\u2212",
-            @"&lowast;", @"\u2217",
-            @"&radic;", @"\u221A",
-            @"&prop;", @"\u221D",
-            @"&infin;", @"\u221E",
-            @"&ang;", @"\u2220",
-            @"&and;", @"\u2227",
-            @"&or;", @"\u2228",
-            @"&cap;", @"\u2229",
-            @"&cup;", @"\u222A",
-            @"&int;", @"\u222B",
-            @"&there4;", @"\u2234",
-            @"&sim;", @"\u223C",
-            @"&cong;", @"\u2245",
-            @"&asymp;", @"\u2248",
-            @"&ne;", @"\u2260",
-            @"&equiv;", @"\u2261",
-            @"&le;", @"\u2264",
-            @"&ge;", @"\u2265",
-            @"&sub;", @"\u2282",
-            @"&sup;", @"\u2283",
-            @"&nsub;", @"\u2284",
-            @"&sube;", @"\u2286",
-            @"&supe;", @"\u2287",
-            @"&oplus;", @"\u2295",
-            @"&otimes;", @"\u2297",
-            @"&perp;", @"\u22A5",
-            @"&sdot;", @"\u22C5",
-            @"&lceil;", @"\u2308",
-            @"&rceil;", @"\u2309",
-            @"&lfloor;", @"\u230A",
-            @"&rfloor;", @"\u230B",
-            @"&lang;", @"\u2329",
-            @"&rang;", @"\u232A",
-            @"&loz;", @"\u25CA",
-            @"&spades;", @"\u2660",
-            @"&clubs;", @"\u2663",
-            @"&hearts;", @"\u2665",
-            @"&diams;", @"\u2666",
-        nil];
-    }
-    NSMutableString* newString = [NSMutableString stringWithString:string];
-    for(NSString* key in entities) {
-        [newString replaceOccurrencesOfString:[entities objectForKey:key] withString:key options:0 range:NSMakeRange(0, newString.length)];
-    }
-    return newString;
+    return _StringWithReplacedEntities(string, _LookupEntity);
 }
 
 + (Class) SGMLElementClass {
@@ -324,6 +355,10 @@
 
 @implementation ParserNodeHTMLTag
 
++ (NSString*) stringWithReplacedEntities:(NSString*)string {
+    return [ParserLanguageHTML stringWithReplacedEntities:string];
+}
+
 /* http://www.w3.org/TR/REC-html40/index/elements.html */
 + (NSSet*) emptyTags {
     static NSSet* set = nil;
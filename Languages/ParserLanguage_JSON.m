@@ -58,29 +58,32 @@
     return [NSSet setWithObject:@"json"];
 }
 
-- (ParserNode*) performSyntaxAnalysis:(NSUInteger)passIndex forNode:(ParserNode*)node textBuffer:(const unichar*)textBuffer topLevelLanguage:(ParserLanguage*)topLevelLanguage {
-    
-    if([node isMemberOfClass:[ParserNodeText class]]) {
+static ParserNode* _AnalyzeText(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    if(IS_MEMBER_OF_KIND(node, Text)) {
         return [node replaceWithNodeOfClass:[ParserNodeJSONNumber class] preserveChildren:NO];
     }
-    if([node isKindOfClass:[ParserNodeBraces class]]) {
-        return [node replaceWithNodeOfClass:[ParserNodeJSONObject class] preserveChildren:YES];
-    }
-    if([node isKindOfClass:[ParserNodeBrackets class]]) {
-        return [node replaceWithNodeOfClass:[ParserNodeJSONArray class] preserveChildren:YES];
-    }
     
-    if([node.parent isKindOfClass:[ParserNodeJSONObject class]]) {
-        if([node isKindOfClass:[ParserNodeJSONString class]]) {
-            ParserNode* nextNode = [node findNextSiblingIgnoringWhitespaceAndNewline];
-            if([nextNode isKindOfClass:[ParserNodeColon class]]) {
-                nextNode = [nextNode findNextSiblingIgnoringWhitespaceAndNewline];
-                if(nextNode) {
-                    ParserNode* newNode = [[ParserNodeJSONPair alloc] initWithText:node.text range:NSMakeRange(node.range.location, 0)];
-                    [node insertPreviousSibling:newNode];
-                    [newNode release];
-                    _RearrangeNodesAsParentAndChildren(newNode, nextNode);
-                }
+    return node;
+}
+
+static ParserNode* _AnalyzeBraces(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    return [node replaceWithNodeOfClass:[ParserNodeJSONObject class] preserveChildren:YES];
+}
+
+static ParserNode* _AnalyzeBrackets(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    return [node replaceWithNodeOfClass:[ParserNodeJSONArray class] preserveChildren:YES];
+}
+
+static ParserNode* _AnalyzeString(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    if(IS_KIND(node.parent, JSONObject)) {
+        ParserNode* nextNode = [node findNextSiblingIgnoringWhitespaceAndNewline];
+        if(IS_KIND(nextNode, Colon)) {
+            nextNode = [nextNode findNextSiblingIgnoringWhitespaceAndNewline];
+            if(nextNode) {
+                ParserNode* newNode = [[ParserNodeJSONPair alloc] initWithText:node.text range:NSMakeRange(node.range.location, 0)];
+                [node insertPreviousSibling:newNode];
+                [newNode release];
+                _RearrangeNodesAsParentAndChildren(newNode, nextNode);
             }
         }
     }
@@ -88,10 +91,25 @@
     return node;
 }
 
++ (const ParserSyntaxAnalysisRule*) languageSyntaxAnalysisRules {
+    static const ParserSyntaxAnalysisRule rules[] = {
+        {0, "ParserNodeText", _AnalyzeText},
+        {0, "ParserNodeBraces", _AnalyzeBraces},
+        {0, "ParserNodeBrackets", _AnalyzeBrackets},
+        {0, "ParserNodeJSONString", _AnalyzeString},
+        {0, NULL, NULL}
+    };
+    return rules;
+}
+
 @end
 
 @implementation ParserNodeJSONString
 
++ (NSString*) prefixCharacters {
+    return @"\"";
+}
+
 + (NSUInteger) isMatchingPrefix:(const unichar*)string maxLength:(NSUInteger)maxLength {
     return (*string == '"') ? 1 : NSNotFound;
 }
@@ -100,6 +118,8 @@
     return (*string == '"') && !((*(string - 1) == '\\') && (*(string - 2) != '\\')) ? 1 : NSNotFound;
 }
 
+TERMINATOR_METHOD("\"", '\\')
+
 - (NSString*) cleanContent {
     NSRange range = self.range;
     return _CleanEscapedString([self.text substringWithRange:NSMakeRange(range.location + 1, range.length - 2)]);
@@ -111,9 +131,19 @@
 @end
 
 @implementation ParserNodeJSONArray
+
++ (BOOL) isReparseBoundary {
+    return YES;
+}
+
 @end
 
 @implementation ParserNodeJSONObject
+
++ (BOOL) isReparseBoundary {
+    return YES;
+}
+
 @end
 
 @implementation ParserNodeJSONPair
@@ -85,181 +85,213 @@
 }
 
 static BOOL _HasInterfaceOrProtocolParent(ParserNode* node) {
-    if([node.parent isKindOfClass:[ParserNodeObjCInterface class]] || [node.parent isKindOfClass:[ParserNodeObjCPrivate class]] || [node.parent isKindOfClass:[ParserNodeObjCProtected class]] || [node.parent isKindOfClass:[ParserNodeObjCPublic class]]
-        || [node.parent isKindOfClass:[ParserNodeObjCProtocol class]] || [node.parent isKindOfClass:[ParserNodeObjCProtected class]] || [node.parent isKindOfClass:[ParserNodeObjCOptional class]]) {
+    if(IS_KIND(node.parent, ObjCInterface) || IS_KIND(node.parent, ObjCPrivate) || IS_KIND(node.parent, ObjCProtected) || IS_KIND(node.parent, ObjCPublic)
+        || IS_KIND(node.parent, ObjCProtocol) || IS_KIND(node.parent, ObjCProtected) || IS_KIND(node.parent, ObjCOptional)) {
         return YES;
     }
     
-    return [node.parent isKindOfClass:[ParserNodeCPreprocessorCondition class]] ? _HasInterfaceOrProtocolParent(node.parent) : NO;
+    return IS_KIND(node.parent, CPreprocessorCondition) ? _HasInterfaceOrProtocolParent(node.parent) : NO;
 }
 
 static BOOL _HasImplementationParent(ParserNode* node) {
-    if([node.parent isKindOfClass:[ParserNodeObjCImplementation class]]) {
+    if(IS_KIND(node.parent, ObjCImplementation)) {
         return YES;
     }
     
-    return [node.parent isKindOfClass:[ParserNodeCPreprocessorCondition class]] ? _HasImplementationParent(node.parent) : NO;
+    return IS_KIND(node.parent, CPreprocessorCondition) ? _HasImplementationParent(node.parent) : NO;
 }
 
-- (ParserNode*) performSyntaxAnalysis:(NSUInteger)passIndex forNode:(ParserNode*)node textBuffer:(const unichar*)textBuffer topLevelLanguage:(ParserLanguage*)topLevelLanguage {
+static ParserNode* _AnalyzeBraces(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    ParserNode* previousNode = [node findPreviousSiblingIgnoringWhitespaceAndNewline];
     
-   if(passIndex == 0) {
-        if([node isKindOfClass:[ParserNodeBraces class]]) {
-            ParserNode* previousNode = [node findPreviousSiblingIgnoringWhitespaceAndNewline];
-            
-            // "@catch() {}" "@synchronized() {}"
-            if([previousNode isKindOfClass:[ParserNodeParenthesis class]]) {
-                previousNode = [previousNode findPreviousSiblingIgnoringWhitespaceAndNewline];
-                if([previousNode isKindOfClass:[ParserNodeObjCCatch class]] || [previousNode isKindOfClass:[ParserNodeObjCSynchronized class]]) {
-                    _RearrangeNodesAsParentAndChildren(previousNode, node);
-                }
-            }
-            
-            // "@try {}" "@finally {}"
-            else if([previousNode isKindOfClass:[ParserNodeObjCTry class]] || [previousNode isKindOfClass:[ParserNodeObjCFinally class]]) {
-                _RearrangeNodesAsParentAndChildren(previousNode, node);
-            }
-            
-        } else if([node isKindOfClass:[ParserNodeObjCSelector class]] || [node isKindOfClass:[ParserNodeObjCEncode class]]) {
-            
-            // "@selector()" "@encode()"
-            ParserNode* nextNode = [node findNextSiblingIgnoringWhitespaceAndNewline];
-            if([nextNode isKindOfClass:[ParserNodeParenthesis class]]) {
-                _RearrangeNodesAsParentAndChildren(node, nextNode);
-            }
-            
-        } else if([node isKindOfClass:[ParserNodeObjCThrow class]]) {
-            
-            // "@throw" "@throw foo"
-            ParserNode* semicolonNode = [node findNextSiblingOfClass:[ParserNodeSemicolon class]];
-            if(semicolonNode) {
-                if(semicolonNode.previousSibling != node) {
-                    _RearrangeNodesAsParentAndChildren(node, semicolonNode);
-                }
-            } else {
-                if([node.parent isKindOfClass:[ParserNodeCConditionIf class]] || [node.parent isKindOfClass:[ParserNodeCConditionElse class]] || [node.parent isKindOfClass:[ParserNodeCConditionElseIf class]]
-                    || [node.parent isKindOfClass:[ParserNodeCFlowFor class]] || [node.parent isKindOfClass:[ParserNodeCFlowWhile class]]) {
-                    _RearrangeNodesAsParentAndChildren(node, node.parent.lastChild);
-                }
-            }
-            
-        } else if([node isKindOfClass:[ParserNodeObjCProperty class]] && _HasInterfaceOrProtocolParent(node)) {
-            
-            // "@property" "@property()"
-            ParserNode* semicolonNode = [node findNextSiblingOfClass:[ParserNodeSemicolon class]];
-            if(semicolonNode) {
-                _RearrangeNodesAsParentAndChildren(node, semicolonNode);
-            }
-            
-        } else if([node isKindOfClass:[ParserNodeObjCSynthesize class]] && _HasImplementationParent(node)) {
-            
-            // "@synthesize"
+    // "@catch() {}" "@synchronized() {}"
+    if(IS_KIND(previousNode, Parenthesis)) {
+        previousNode = [previousNode findPreviousSiblingIgnoringWhitespaceAndNewline];
+        if(IS_KIND(previousNode, ObjCCatch) || IS_KIND(previousNode, ObjCSynchronized)) {
+            _RearrangeNodesAsParentAndChildren(previousNode, node);
+        }
+    }
+    
+    // "@try {}" "@finally {}"
+    else if(IS_KIND(previousNode, ObjCTry) || IS_KIND(previousNode, ObjCFinally)) {
+        _RearrangeNodesAsParentAndChildren(previousNode, node);
+    }
+    
+    return node;
+}
+
+static ParserNode* _AnalyzeSelectorOrEncode(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    // "@selector()" "@encode()"
+    ParserNode* nextNode = [node findNextSiblingIgnoringWhitespaceAndNewline];
+    if(IS_KIND(nextNode, Parenthesis)) {
+        _RearrangeNodesAsParentAndChildren(node, nextNode);
+    }
+    
+    return node;
+}
+
+static ParserNode* _AnalyzeThrow(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    // "@throw" "@throw foo"
+    ParserNode* semicolonNode = [node findNextSiblingOfClass:[ParserNodeSemicolon class]];
+    if(semicolonNode) {
+        if(semicolonNode.previousSibling != node) {
+            _RearrangeNodesAsParentAndChildren(node, semicolonNode);
+        }
+    } else {
+        if(IS_KIND(node.parent, CConditionIf) || IS_KIND(node.parent, CConditionElse) || IS_KIND(node.parent, CConditionElseIf)
+            || IS_KIND(node.parent, CFlowFor) || IS_KIND(node.parent, CFlowWhile)) {
+            _RearrangeNodesAsParentAndChildren(node, node.parent.lastChild);
+        }
+    }
+    
+    return node;
+}
+
+static ParserNode* _AnalyzeProperty(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    if(_HasInterfaceOrProtocolParent(node)) {
+        // "@property" "@property()"
+        ParserNode* semicolonNode = [node findNextSiblingOfClass:[ParserNodeSemicolon class]];
+        if(semicolonNode) {
+            _RearrangeNodesAsParentAndChildren(node, semicolonNode);
+        }
+    }
+    
+    return node;
+}
+
+static ParserNode* _AnalyzeSynthesize(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    if(_HasImplementationParent(node)) {
+        // "@synthesize"
+        ParserNode* semicolonNode = [node findNextSiblingOfClass:[ParserNodeSemicolon class]];
+        if(semicolonNode) {
+            _RearrangeNodesAsParentAndChildren(node, semicolonNode);
+        }
+    }
+    
+    return node;
+}
+
+static ParserNode* _AnalyzeVisibility(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    // "@private ..." "@protected ..." "@public ..."
+    ParserNode* endNode = [node.parent.lastChild findPreviousSiblingIgnoringWhitespaceAndNewline]; //Last child is guaranted to be "@end"
+    ParserNode* otherNode = [node findNextSiblingOfClass:[ParserNodeObjCPrivate class]];
+    if(otherNode && (otherNode.range.location < endNode.range.location)) {
+        endNode = otherNode.previousSibling;
+    }
+    otherNode = [node findNextSiblingOfClass:[ParserNodeObjCProtected class]];
+    if(otherNode && (otherNode.range.location < endNode.range.location)) {
+        endNode = otherNode.previousSibling;
+    }
+    otherNode = [node findNextSiblingOfClass:[ParserNodeObjCPublic class]];
+    if(otherNode && (otherNode.range.location < endNode.range.location)) {
+        endNode = otherNode.previousSibling;
+    }
+    if(IS_KIND(endNode, Whitespace) || IS_KIND(endNode, Newline)) {
+        endNode = [endNode findPreviousSiblingIgnoringWhitespaceAndNewline];
+    }
+    _RearrangeNodesAsParentAndChildren(node, endNode);
+    
+    return node;
+}
+
+static ParserNode* _AnalyzeRequiredOrOptional(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    // "@required ..." @"@optional ..."
+    ParserNode* endNode = [node.parent.lastChild findPreviousSiblingIgnoringWhitespaceAndNewline]; //Last child is guaranted to be "@end"
+    ParserNode* otherNode = [node findNextSiblingOfClass:[ParserNodeObjCRequired class]];
+    if(otherNode && (otherNode.range.location < endNode.range.location)) {
+        endNode = otherNode.previousSibling;
+    }
+    otherNode = [node findNextSiblingOfClass:[ParserNodeObjCOptional class]];
+    if(otherNode && (otherNode.range.location < endNode.range.location)) {
+        endNode = otherNode.previousSibling;
+    }
+    if(IS_KIND(endNode, Whitespace) || IS_KIND(endNode, Newline)) {
+        endNode = [endNode findPreviousSiblingIgnoringWhitespaceAndNewline];
+    }
+    _RearrangeNodesAsParentAndChildren(node, endNode);
+    
+    return node;
+}
+
+static ParserNode* _AnalyzeText(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    if(IS_MEMBER_OF_KIND(node, Text) && _HasInterfaceOrProtocolParent(node)) {
+        // "-(foo)bar" "+(foo)bar" "-bar" "+bar"
+        NSString* content = node.content;
+        if([content isEqualToString:@"-"] || [content isEqualToString:@"+"]) {
             ParserNode* semicolonNode = [node findNextSiblingOfClass:[ParserNodeSemicolon class]];
             if(semicolonNode) {
-                _RearrangeNodesAsParentAndChildren(node, semicolonNode);
-            }
-            
-        } else if([node isKindOfClass:[ParserNodeObjCPrivate class]] || [node isKindOfClass:[ParserNodeObjCProtected class]] || [node isKindOfClass:[ParserNodeObjCPublic class]]) {
-            
-            // "@private ..." "@protected ..." "@public ..."
-            ParserNode* endNode = [node.parent.lastChild findPreviousSiblingIgnoringWhitespaceAndNewline]; //Last child is guaranted to be "@end"
-            ParserNode* otherNode = [node findNextSiblingOfClass:[ParserNodeObjCPrivate class]];
-            if(otherNode && (otherNode.range.location < endNode.range.location)) {
-                endNode = otherNode.previousSibling;
-            }
-            otherNode = [node findNextSiblingOfClass:[ParserNodeObjCProtected class]];
-            if(otherNode && (otherNode.range.location < endNode.range.location)) {
-                endNode = otherNode.previousSibling;
-            }
-            otherNode = [node findNextSiblingOfClass:[ParserNodeObjCPublic class]];
-            if(otherNode && (otherNode.range.location < endNode.range.location)) {
-                endNode = otherNode.previousSibling;
+                node = [node replaceWithNodeOfClass:[ParserNodeMatch class] preserveChildren:NO];
+                
+                ParserNode* newNode = [[ParserNodeObjCMethodDeclaration alloc] initWithText:node.text range:NSMakeRange(node.range.location, 0)];
+                [node insertPreviousSibling:newNode];
+                [newNode release];
+                _RearrangeNodesAsParentAndChildren(newNode, semicolonNode);
             }
-            if([endNode isKindOfClass:[ParserNodeWhitespace class]] || [endNode isKindOfClass:[ParserNodeNewline class]]) {
-                endNode = [endNode findPreviousSiblingIgnoringWhitespaceAndNewline];
-            }
-            _RearrangeNodesAsParentAndChildren(node, endNode);
-            
-        } else if([node isKindOfClass:[ParserNodeObjCRequired class]] || [node isKindOfClass:[ParserNodeObjCOptional class]]) {
-            
-            // "@required ..." @"@optional ..."
-            ParserNode* endNode = [node.parent.lastChild findPreviousSiblingIgnoringWhitespaceAndNewline]; //Last child is guaranted to be "@end"
-            ParserNode* otherNode = [node findNextSiblingOfClass:[ParserNodeObjCRequired class]];
-            if(otherNode && (otherNode.range.location < endNode.range.location)) {
-                endNode = otherNode.previousSibling;
-            }
-            otherNode = [node findNextSiblingOfClass:[ParserNodeObjCOptional class]];
-            if(otherNode && (otherNode.range.location < endNode.range.location)) {
-                endNode = otherNode.previousSibling;
-            }
-            if([endNode isKindOfClass:[ParserNodeWhitespace class]] || [endNode isKindOfClass:[ParserNodeNewline class]]) {
-                endNode = [endNode findPreviousSiblingIgnoringWhitespaceAndNewline];
-            }
-            _RearrangeNodesAsParentAndChildren(node, endNode);
-            
-        } else if([node isMemberOfClass:[ParserNodeText class]] && _HasInterfaceOrProtocolParent(node)) {
-            
-            // "-(foo)bar" "+(foo)bar" "-bar" "+bar"
-            NSString* content = node.content;
-            if([content isEqualToString:@"-"] || [content isEqualToString:@"+"]) {
-                ParserNode* semicolonNode = [node findNextSiblingOfClass:[ParserNodeSemicolon class]];
-                if(semicolonNode) {
-                    node = [node replaceWithNodeOfClass:[ParserNodeMatch class] preserveChildren:NO];
-                    
-                    ParserNode* newNode = [[ParserNodeObjCMethodDeclaration alloc] initWithText:node.text range:NSMakeRange(node.range.location, 0)];
-                    [node insertPreviousSibling:newNode];
-                    [newNode release];
-                    _RearrangeNodesAsParentAndChildren(newNode, semicolonNode);
-                }
-            }
-            
-        } else if([node isMemberOfClass:[ParserNodeText class]] && _HasImplementationParent(node)) {
-            
-            // "-(foo)bar" "+(foo)bar" "-bar" "+bar"
-            NSString* content = node.content;
-            if([content isEqualToString:@"-"] || [content isEqualToString:@"+"]) {
-                ParserNode* nextNode = [node findNextSiblingOfClass:[ParserNodeBraces class]];
-                if(nextNode) {
-                    node = [node replaceWithNodeOfClass:[ParserNodeMatch class] preserveChildren:NO];
-                    
-                    ParserNode* newNode = [[ParserNodeObjCMethodImplementation alloc] initWithText:node.text range:NSMakeRange(node.range.location, 0)];
-                    [node insertPreviousSibling:newNode];
-                    [newNode release];
-                    _RearrangeNodesAsParentAndChildren(newNode, nextNode);
-                }
+        }
+    } else if(IS_MEMBER_OF_KIND(node, Text) && _HasImplementationParent(node)) {
+        // "-(foo)bar" "+(foo)bar" "-bar" "+bar"
+        NSString* content = node.content;
+        if([content isEqualToString:@"-"] || [content isEqualToString:@"+"]) {
+            ParserNode* nextNode = [node findNextSiblingOfClass:[ParserNodeBraces class]];
+            if(nextNode) {
+                node = [node replaceWithNodeOfClass:[ParserNodeMatch class] preserveChildren:NO];
+                
+                ParserNode* newNode = [[ParserNodeObjCMethodImplementation alloc] initWithText:node.text range:NSMakeRange(node.range.location, 0)];
+                [node insertPreviousSibling:newNode];
+                [newNode release];
+                _RearrangeNodesAsParentAndChildren(newNode, nextNode);
             }
-            
         }
     }
     
-    if(passIndex == 1) {
-        if([node isKindOfClass:[ParserNodeBrackets class]] && node.children) {
-            
-            // "[foo bar:baz]"
-            ParserNode* target = [node.firstChild findNextSiblingIgnoringWhitespaceAndNewline];
-            if([target isKindOfClass:[ParserNodeParenthesis class]]) {
-                target = [target findNextSiblingIgnoringWhitespaceAndNewline];
-            }
-            if([target isMemberOfClass:[ParserNodeText class]] || [target isKindOfClass:[ParserNodeObjCSelf class]] || [target isKindOfClass:[ParserNodeObjCSuper class]]
-                || [target isKindOfClass:[ParserNodeBrackets class]] || [target isKindOfClass:[ParserNodeCFunctionCall class]] || [target isKindOfClass:[ParserNodeObjCString class]]) {
-                if([target.nextSibling isKindOfClass:[ParserNodeWhitespace class]] || [target.nextSibling isKindOfClass:[ParserNodeNewline class]]) {
-                    ParserNode* nextNode = [target findNextSiblingIgnoringWhitespaceAndNewline];
-                    if([nextNode isMemberOfClass:[ParserNodeText class]]) {
-                        if([target isMemberOfClass:[ParserNodeText class]]) {
-                            [target replaceWithNodeOfClass:[ParserNodeMatch class] preserveChildren:NO];
-                        }
-                        
-                        return [node replaceWithNodeOfClass:[ParserNodeObjCMethodCall class] preserveChildren:YES];
+    return node;
+}
+
+static ParserNode* _AnalyzeBrackets(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    if(node.children) {
+        // "[foo bar:baz]"
+        ParserNode* target = [node.firstChild findNextSiblingIgnoringWhitespaceAndNewline];
+        if(IS_KIND(target, Parenthesis)) {
+            target = [target findNextSiblingIgnoringWhitespaceAndNewline];
+        }
+        if(IS_MEMBER_OF_KIND(target, Text) || IS_KIND(target, ObjCSelf) || IS_KIND(target, ObjCSuper)
+            || IS_KIND(target, Brackets) || IS_KIND(target, CFunctionCall) || IS_KIND(target, ObjCString)) {
+            if(IS_KIND(target.nextSibling, Whitespace) || IS_KIND(target.nextSibling, Newline)) {
+                ParserNode* nextNode = [target findNextSiblingIgnoringWhitespaceAndNewline];
+                if(IS_MEMBER_OF_KIND(nextNode, Text)) {
+                    if(IS_MEMBER_OF_KIND(target, Text)) {
+                        [target replaceWithNodeOfClass:[ParserNodeMatch class] preserveChildren:NO];
                     }
+                    
+                    return [node replaceWithNodeOfClass:[ParserNodeObjCMethodCall class] preserveChildren:YES];
                 }
             }
-            
         }
     }
     
     return node;
 }
 
++ (const ParserSyntaxAnalysisRule*) languageSyntaxAnalysisRules {
+    static const ParserSyntaxAnalysisRule rules[] = {
+        {0, "ParserNodeBraces", _AnalyzeBraces},
+        {0, "ParserNodeObjCSelector", _AnalyzeSelectorOrEncode},
+        {0, "ParserNodeObjCEncode", _AnalyzeSelectorOrEncode},
+        {0, "ParserNodeObjCThrow", _AnalyzeThrow},
+        {0, "ParserNodeObjCProperty", _AnalyzeProperty},
+        {0, "ParserNodeObjCSynthesize", _AnalyzeSynthesize},
+        {0, "ParserNodeObjCPrivate", _AnalyzeVisibility},
+        {0, "ParserNodeObjCProtected", _AnalyzeVisibility},
+        {0, "ParserNodeObjCPublic", _AnalyzeVisibility},
+        {0, "ParserNodeObjCRequired", _AnalyzeRequiredOrOptional},
+        {0, "ParserNodeObjCOptional", _AnalyzeRequiredOrOptional},
+        {0, "ParserNodeText", _AnalyzeText},
+        {1, "ParserNodeBrackets", _AnalyzeBrackets},
+        {0, NULL, NULL}
+    };
+    return rules;
+}
+
 @end
 
 /* WARNING: Keep in sync with C #include */
@@ -288,6 +320,10 @@ IS_MATCHING_PREFIX_METHOD_WITH_TRAILING_CHARACTERS("#import", true, NULL)
     return [NSSet setWithObject:[ParserNodeCString class]];
 }
 
++ (NSString*) prefixCharacters {
+    return @"@";
+}
+
 + (NSUInteger) isMatchingPrefix:(const unichar*)string maxLength:(NSUInteger)maxLength {
     return (string[0] == '@') && (string[1] == '"') ? 2 : NSNotFound;
 }
@@ -309,6 +345,8 @@ KEYWORD_CLASS_IMPLEMENTATION(ObjC, Nil, "nil")
     return NO; \
 } \
 \
+PREFIX_CHARACTERS_METHOD(__TOKEN__) \
+\
 + (NSUInteger) isMatchingPrefix:(const unichar*)string maxLength:(NSUInteger)maxLength { \
     IS_MATCHING_CHARACTERS_EXTENDED(__TOKEN__, true, NULL, string, maxLength) \
     if(_matching != NSNotFound) { \
@@ -367,14 +405,14 @@ IMPLEMENTATION(Encode, "@encode", true, "(")
 static NSString* _SelectorFromMethod(ParserNode* node) {
     NSMutableString* string = [NSMutableString string];
     node = [node findNextSiblingIgnoringWhitespaceAndNewline];
-    if([node isKindOfClass:[ParserNodeParenthesis class]]) {
+    if(IS_KIND(node, Parenthesis)) {
         node = [node findNextSiblingIgnoringWhitespaceAndNewline];
     }
     ParserNode* colonNode = [node findNextSiblingOfClass:[ParserNodeColon class]];
     if(colonNode) {
         node = colonNode;
         while(node) {
-            if(![node.previousSibling isKindOfClass:[ParserNodeWhitespace class]] && ![node.previousSibling isKindOfClass:[ParserNodeNewline class]]) {
+            if(!IS_KIND(node.previousSibling, Whitespace) && !IS_KIND(node.previousSibling, Newline)) {
                 [string appendString:node.previousSibling.content];
             }
             [string appendString:node.content];
@@ -432,7 +470,7 @@ static NSString* _SelectorFromMethod(ParserNode* node) {
     if(_name == nil) {
         ParserNode* node = self.firstChild;
         node = [node findNextSiblingIgnoringWhitespaceAndNewline];
-        if([node isKindOfClass:[ParserNodeParenthesis class]]) {
+        if(IS_KIND(node, Parenthesis)) {
             node = [node findNextSiblingIgnoringWhitespaceAndNewline];
         }
         _name = [_SelectorFromMethod(node) retain];
@@ -54,46 +54,39 @@
     return [NSSet setWithObject:@"plist"];
 }
 
-- (ParserNode*) performSyntaxAnalysis:(NSUInteger)passIndex forNode:(ParserNode*)node textBuffer:(const unichar*)textBuffer topLevelLanguage:(ParserLanguage*)topLevelLanguage {
-    
-    if([node isKindOfClass:[ParserNodeXMLElement class]]) {
-        NSString* name = node.name;
-        if([name isEqualToString:@"plist"]) {
-            return [node replaceWithNodeOfClass:[ParserNodePropertyList class] preserveChildren:YES];
-        }
-        if([name isEqualToString:@"dict"]) {
-            return [node replaceWithNodeOfClass:[ParserNodePropertyListDictionary class] preserveChildren:YES];
-        }
-        if([name isEqualToString:@"array"]) {
-            return [node replaceWithNodeOfClass:[ParserNodePropertyListArray class] preserveChildren:YES];
-        }
-        if([name isEqualToString:@"key"]) {
-            return [node replaceWithNodeOfClass:[ParserNodePropertyListKey class] preserveChildren:YES];
-        }
-        if([name isEqualToString:@"string"]) {
-            return [node replaceWithNodeOfClass:[ParserNodePropertyListString class] preserveChildren:YES];
-        }
-        if([name isEqualToString:@"data"]) {
-            return [node replaceWithNodeOfClass:[ParserNodePropertyListData class] preserveChildren:YES];
-        }
-        if([name isEqualToString:@"date"]) {
-            return [node replaceWithNodeOfClass:[ParserNodePropertyListDate class] preserveChildren:YES];
-        }
-        if([name isEqualToString:@"true"]) {
-            return [node replaceWithNodeOfClass:[ParserNodePropertyListTrue class] preserveChildren:YES];
-        }
-        if([name isEqualToString:@"false"]) {
-            return [node replaceWithNodeOfClass:[ParserNodePropertyListFalse class] preserveChildren:YES];
-        }
-        if([name isEqualToString:@"real"]) {
-            return [node replaceWithNodeOfClass:[ParserNodePropertyListReal class] preserveChildren:YES];
-        }
-        if([name isEqualToString:@"integer"]) {
-            return [node replaceWithNodeOfClass:[ParserNodePropertyListInteger class] preserveChildren:YES];
+static ParserNode* _AnalyzeElement(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    static ParserElementClassTable* table = NULL;
+    if(table == NULL) {
+        static const ParserElementClassMapping mappings[] = {
+            {"plist", "ParserNodePropertyList"},
+            {"dict", "ParserNodePropertyListDictionary"},
+            {"array", "ParserNodePropertyListArray"},
+            {"key", "ParserNodePropertyListKey"},
+            {"string", "ParserNodePropertyListString"},
+            {"data", "ParserNodePropertyListData"},
+            {"date", "ParserNodePropertyListDate"},
+            {"true", "ParserNodePropertyListTrue"},
+            {"false", "ParserNodePropertyListFalse"},
+            {"real", "ParserNodePropertyListReal"},
+            {"integer", "ParserNodePropertyListInteger"},
+            {NULL, NULL}
+        };
+        ParserElementClassTable* newTable = _ParserElementClassTableCreate(mappings, NO);
+        if(!__sync_bool_compare_and_swap(&table, NULL, newTable)) { //Analyzers can run on multiple threads
+            _ParserElementClassTableRelease(newTable);
         }
     }
     
-    return node;
+    Class class = _ElementClassForName(table, node.name);
+    return class ? [node replaceWithNodeOfClass:class preserveChildren:YES] : node;
+}
+
++ (const ParserSyntaxAnalysisRule*) languageSyntaxAnalysisRules {
+    static const ParserSyntaxAnalysisRule rules[] = {
+        {0, "ParserNodeXMLElement", _AnalyzeElement},
+        {0, NULL, NULL}
+    };
+    return rules;
 }
 
 @end
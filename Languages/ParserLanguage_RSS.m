@@ -60,64 +60,45 @@
     return [NSSet setWithObjects:@"rss", @"atom", nil];
 }
 
-- (ParserNode*) performSyntaxAnalysis:(NSUInteger)passIndex forNode:(ParserNode*)node textBuffer:(const unichar*)textBuffer topLevelLanguage:(ParserLanguage*)topLevelLanguage {
-    
-    if([node isKindOfClass:[ParserNodeXMLElement class]]) {
-        NSString* name = [node.name lowercaseString];
-        if([name isEqualToString:@"channel"]) {
-            return [node replaceWithNodeOfClass:[ParserNodeRSSChannel class] preserveChildren:YES];
-        }
-        if([name isEqualToString:@"item"]) {
-            return [node replaceWithNodeOfClass:[ParserNodeRSSItem class] preserveChildren:YES];
-        }
-        if([name isEqualToString:@"category"]) {
-            return [node replaceWithNodeOfClass:[ParserNodeRSSCategory class] preserveChildren:YES];
-        }
-        if([name isEqualToString:@"title"]) {
-            return [node replaceWithNodeOfClass:[ParserNodeRSSTitle class] preserveChildren:YES];
-        }
-        if([name isEqualToString:@"link"]) {
-            return [node replaceWithNodeOfClass:[ParserNodeRSSLink class] preserveChildren:YES];
-        }
-        if([name isEqualToString:@"description"]) {
-            return [node replaceWithNodeOfClass:[ParserNodeRSSDescription class] preserveChildren:YES];
-        }
-        if([name isEqualToString:@"language"]) {
-            return [node replaceWithNodeOfClass:[ParserNodeRSSLanguage class] preserveChildren:YES];
-        }
-        if([name isEqualToString:@"author"]) {
-            return [node replaceWithNodeOfClass:[ParserNodeRSSAuthor class] preserveChildren:YES];
-        }
-        if([name isEqualToString:@"enclosure"]) {
-            return [node replaceWithNodeOfClass:[ParserNodeRSSEnclosure class] preserveChildren:YES];
-        }
-        if([name isEqualToString:@"guid"]) {
-            return [node replaceWithNodeOfClass:[ParserNodeRSSGuid class] preserveChildren:YES];
-        }
-        if([name isEqualToString:@"feed"]) {
-            return [node replaceWithNodeOfClass:[ParserNodeAtomFeed class] preserveChildren:YES];
-        }
-        if([name isEqualToString:@"entry"]) {
-            return [node replaceWithNodeOfClass:[ParserNodeAtomEntry class] preserveChildren:YES];
-        }
-        if([name isEqualToString:@"subtitle"]) {
-            return [node replaceWithNodeOfClass:[ParserNodeAtomSubtitle class] preserveChildren:YES];
-        }
-        if([name isEqualToString:@"id"]) {
-            return [node replaceWithNodeOfClass:[ParserNodeAtomID class] preserveChildren:YES];
-        }
-        if([name isEqualToString:@"summary"]) {
-            return [node replaceWithNodeOfClass:[ParserNodeAtomSummary class] preserveChildren:YES];
-        }
-        if([name isEqualToString:@"name"]) {
-            return [node replaceWithNodeOfClass:[ParserNodeAtomName class] preserveChildren:YES];
-        }
-        if([name isEqualToString:@"email"]) {
-            return [node replaceWithNodeOfClass:[ParserNodeAtomEmail class] preserveChildren:YES];
+static ParserNode* _AnalyzeElement(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    static ParserElementClassTable* table = NULL;
+    if(table == NULL) {
+        static const ParserElementClassMapping mappings[] = {
+            {"channel", "ParserNodeRSSChannel"},
+            {"item", "ParserNodeRSSItem"},
+            {"category", "ParserNodeRSSCategory"},
+            {"title", "ParserNodeRSSTitle"},
+            {"link", "ParserNodeRSSLink"},
+            {"description", "ParserNodeRSSDescription"},
+            {"language", "ParserNodeRSSLanguage"},
+            {"author", "ParserNodeRSSAuthor"},
+            {"enclosure", "ParserNodeRSSEnclosure"},
+            {"guid", "ParserNodeRSSGuid"},
+            {"feed", "ParserNodeAtomFeed"},
+            {"entry", "ParserNodeAtomEntry"},
+            {"subtitle", "ParserNodeAtomSubtitle"},
+            {"id", "ParserNodeAtomID"},
+            {"summary", "ParserNodeAtomSummary"},
+            {"name", "ParserNodeAtomName"},
+            {"email", "ParserNodeAtomEmail"},
+            {NULL, NULL}
+        };
+        ParserElementClassTable* newTable = _ParserElementClassTableCreate(mappings, YES);
+        if(!__sync_bool_compare_and_swap(&table, NULL, newTable)) { //Analyzers can run on multiple threads
+            _ParserElementClassTableRelease(newTable);
         }
     }
     
-    return node;
+    Class class = _ElementClassForName(table, node.name);
+    return class ? [node replaceWithNodeOfClass:class preserveChildren:YES] : node;
+}
+
++ (const ParserSyntaxAnalysisRule*) languageSyntaxAnalysisRules {
+    static const ParserSyntaxAnalysisRule rules[] = {
+        {0, "ParserNodeXMLElement", _AnalyzeElement},
+        {0, NULL, NULL}
+    };
+    return rules;
 }
 
 @end
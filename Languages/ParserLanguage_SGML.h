@@ -23,6 +23,7 @@
     NSInteger _type;
     NSString* _name;
     NSDictionary* _attributes;
+    BOOL _attributesScanned;
 }
 @end
 
@@ -27,14 +27,8 @@ enum {
 };
 
 @interface ParserNodeSGMLTag ()
++ (NSString*) stringWithReplacedEntities:(NSString*)string;
 @property(nonatomic, readonly) NSInteger sgmlType;
-@property(nonatomic, retain) NSDictionary* attributes;
-@end
-
-@interface ParserNodeSGMLValueSingleQuote : ParserNode
-@end
-
-@interface ParserNodeSGMLValueDoubleQuote : ParserNode
 @end
 
 @implementation ParserLanguageSGML
@@ -55,6 +49,10 @@ enum {
     return classes;
 }
 
++ (BOOL) languageAllowsReparseBoundary:(Class)nodeClass {
+    return NO; //Tags are matched across the whole text so an inserted end tag may close an ancestor element instead
+}
+
 + (NSString*) stringWithReplacedEntities:(NSString*)string {
     return string;
 }
@@ -71,79 +69,77 @@ enum {
     return [NSSet setWithObject:@"sgml"];
 }
 
-- (ParserNode*) performSyntaxAnalysis:(NSUInteger)passIndex forNode:(ParserNode*)node textBuffer:(const unichar*)textBuffer topLevelLanguage:(ParserLanguage*)topLevelLanguage {
+static void _InsertElement(ParserLanguage* language, ParserNode* startNode, ParserNode* endNode) {
+    ParserNode* newNode = [[[[language class] SGMLElementClass] alloc] initWithText:startNode.text range:NSMakeRange(startNode.range.location, 0)];
+    [startNode insertPreviousSibling:newNode];
+    [newNode release];
     
-    if([node isKindOfClass:[ParserNodeSGMLTag class]]) {
-        ParserNodeSGMLTag* sgmlNode = (ParserNodeSGMLTag*)node;
-        if(sgmlNode.sgmlType < 0) {
-            ParserNode* newNode = [[[[self class] SGMLElementClass] alloc] initWithText:node.text range:NSMakeRange(node.range.location, 0)];
-            [node insertPreviousSibling:newNode];
-            [newNode release];
-            
-            _RearrangeNodesAsParentAndChildren(newNode, node);
-        } else if(sgmlNode.sgmlType == kSGMLType_Start) {
-            ParserNodeSGMLTag* endNode = sgmlNode;
-            while(endNode) {
-                endNode = (ParserNodeSGMLTag*)[endNode findNextSiblingOfClass:[ParserNodeSGMLTag class]];
-                if((endNode.sgmlType == kSGMLType_End) && ([endNode.name caseInsensitiveCompare:sgmlNode.name] == NSOrderedSame)) {
-                    break;
-                }
-            }
-            if(endNode) {
-                ParserNode* newNode = [[[[self class] SGMLElementClass] alloc] initWithText:node.text range:NSMakeRange(node.range.location, 0)];
-                [node insertPreviousSibling:newNode];
-                [newNode release];
-                
-                _RearrangeNodesAsParentAndChildren(newNode, endNode);
-            }
+    _RearrangeNodesAsParentAndChildren(newNode, endNode);
+}
+
+/* A start tag is matched with the first end tag of the same name among its following siblings, which are the tags up to the end tag of the innermost element containing it: this is computed in one pass with a stack of the end tags of the open elements instead of scanning siblings for every start tag */
+static void _BuildElements(ParserLanguage* language, ParserNode* parent) {
+    NSArray* children = [NSArray arrayWithArray:parent.children];
+    NSUInteger count = 0;
+    ParserNodeSGMLTag** tags = malloc(children.count * sizeof(ParserNodeSGMLTag*));
+    for(ParserNode* node in children) {
+        if(IS_KIND(node, SGMLTag)) {
+            tags[count++] = (ParserNodeSGMLTag*)node;
+        } else if(node.children) {
+            _BuildElements(language, node);
         }
-        
-        if(sgmlNode.sgmlType != kSGMLType_End) {
-            NSRange range = NSMakeRange(sgmlNode.range.location + 1 + sgmlNode.name.length, sgmlNode.range.length - 1 - sgmlNode.name.length - (sgmlNode.sgmlType == kSGMLType_Empty ? 2 : 1));
-            if(range.length > 0) {
-                static NSMutableArray* classes = nil;
-                if(classes == nil) {
-                    classes = [[NSMutableArray alloc] init];
-                    [classes addObject:[ParserNodeWhitespace class]];
-                    [classes addObject:[ParserNodeNewline class]];
-                    [classes addObject:[ParserNodeEqual class]];
-                    [classes addObject:[ParserNodeSGMLValueSingleQuote class]];
-                    [classes addObject:[ParserNodeSGMLValueDoubleQuote class]];
-                }
-                ParserNodeRoot* root = [ParserLanguage newNodeTreeFromText:sgmlNode.text range:range textBuffer:textBuffer withNodeClasses:classes];
-                if(root) {
-                    ParserNode* attributeNode = [root.firstChild findNextSiblingIgnoringWhitespaceAndNewline];
-                    NSMutableDictionary* dictionary = nil;
-                    while([attributeNode isKindOfClass:[ParserNodeText class]]) {
-                        NSString* name = attributeNode.content;
-                        attributeNode = [attributeNode findNextSiblingIgnoringWhitespaceAndNewline];
-                        if(attributeNode == nil) {
-                            break;
-                        }
-                        NSString* value;
-                        if([attributeNode isKindOfClass:[ParserNodeEqual class]]) {
-                            attributeNode = [attributeNode findNextSiblingIgnoringWhitespaceAndNewline];
-                            value = attributeNode.cleanContent;
-                            attributeNode = [attributeNode findNextSiblingIgnoringWhitespaceAndNewline];
-                        } else {
-                            value = @""; //FIXME: Is this the best placeholder?
-                        }
-                        if(dictionary == nil) {
-                            dictionary = [[NSMutableDictionary alloc] init];
-                        }
-                        [dictionary setObject:[[self class] stringWithReplacedEntities:value] forKey:[[self class] stringWithReplacedEntities:name]];
-                    }
-                    sgmlNode.attributes = dictionary;
-                    [dictionary release];
-                    [root release];
+    }
+    
+    NSUInteger* endIndexes = malloc(count * sizeof(NSUInteger)); //Index of the next end tag of the same name for each tag
+    NSMutableDictionary* nextEndIndexes = [[NSMutableDictionary alloc] init];
+    for(NSUInteger i = count; i > 0; --i) {
+        ParserNodeSGMLTag* tag = tags[i - 1];
+        endIndexes[i - 1] = NSNotFound;
+        if((tag.sgmlType == kSGMLType_Start) || (tag.sgmlType == kSGMLType_End)) {
+            NSString* name = [tag.name stringByFoldingWithOptions:NSCaseInsensitiveSearch locale:nil];
+            if(tag.sgmlType == kSGMLType_Start) {
+                NSNumber* index = [nextEndIndexes objectForKey:name];
+                if(index) {
+                    endIndexes[i - 1] = [index unsignedIntegerValue];
                 }
+            } else {
+                [nextEndIndexes setObject:[NSNumber numberWithUnsignedInteger:(i - 1)] forKey:name];
             }
         }
     }
+    [nextEndIndexes release];
     
+    NSUInteger* openEndIndexes = malloc(count * sizeof(NSUInteger));
+    NSUInteger depth = 0;
+    for(NSUInteger i = 0; i < count; ++i) {
+        while(depth && (openEndIndexes[depth - 1] < i)) {
+            --depth;
+        }
+        if(tags[i].sgmlType < 0) {
+            _InsertElement(language, tags[i], tags[i]);
+        } else if((endIndexes[i] != NSNotFound) && (!depth || (endIndexes[i] <= openEndIndexes[depth - 1]))) {
+            _InsertElement(language, tags[i], tags[endIndexes[i]]);
+            openEndIndexes[depth++] = endIndexes[i];
+        }
+    }
+    free(openEndIndexes);
+    free(endIndexes);
+    free(tags);
+}
+
+static ParserNode* _AnalyzeRoot(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    _BuildElements(language, node);
     return node;
 }
 
++ (const ParserSyntaxAnalysisRule*) languageSyntaxAnalysisRules {
+    static const ParserSyntaxAnalysisRule rules[] = {
+        {0, "ParserNodeRoot", _AnalyzeRoot},
+        {0, NULL, NULL}
+    };
+    return rules;
+}
+
 @end
 
 PREFIX_SUFFIX_CLASS_IMPLEMENTATION(SGMLDOCTYPE, "<!DOCTYPE", ">")
@@ -186,12 +182,18 @@ PREFIX_SUFFIX_CLASS_IMPLEMENTATION(SGMLCDATA, "<![CDATA[", "]]>")
 
 @implementation ParserNodeSGMLTag
 
-@synthesize attributes=_attributes;
-
 + (NSSet*) emptyTags {
   return nil;
 }
 
++ (NSString*) stringWithReplacedEntities:(NSString*)string {
+    return [ParserLanguageSGML stringWithReplacedEntities:string];
+}
+
++ (NSString*) prefixCharacters {
+    return @"<";
+}
+
 + (NSUInteger) isMatchingPrefix:(const unichar*)string maxLength:(NSUInteger)maxLength {
     if(*string != '<') {
         return NSNotFound;
@@ -259,10 +261,128 @@ PREFIX_SUFFIX_CLASS_IMPLEMENTATION(SGMLCDATA, "<![CDATA[", "]]>")
     return _name;
 }
 
+typedef enum {
+    kAttributeToken_Whitespace = 0, //Includes newlines
+    kAttributeToken_Equal,
+    kAttributeToken_Word, //Includes unterminated quoted values
+    kAttributeToken_Value
+} AttributeTokenType;
+
+typedef struct {
+    AttributeTokenType type;
+    NSRange range; //Quotes are not part of values
+} AttributeToken;
+
+static inline BOOL _IsAttributeDelimiter(unichar character) {
+    return IsWhitespaceOrNewline(character) || (character == '=') || (character == '\'') || (character == '"');
+}
+
+//Returns the index of the next token after "index" which is not whitespace or NSNotFound
+static inline NSUInteger _NextAttributeToken(const AttributeToken* tokens, NSUInteger count, NSUInteger index) {
+    for(++index; index < count; ++index) {
+        if(tokens[index].type != kAttributeToken_Whitespace) {
+            return index;
+        }
+    }
+    return NSNotFound;
+}
+
+/* Attributes are only extracted from the tag the first time they are requested */
+- (NSDictionary*) attributes {
+    if(_attributesScanned) {
+        return _attributes;
+    }
+    _attributesScanned = YES;
+    if((self.sgmlType == kSGMLType_End) || (_name == nil)) {
+        return nil;
+    }
+    
+    NSRange range = self.range;
+    NSUInteger offset = 1 + _name.length;
+    NSUInteger end = range.length - (_type == kSGMLType_Empty ? 2 : 1);
+    if(end <= offset) {
+        return nil;
+    }
+    unichar* buffer = malloc(range.length * sizeof(unichar));
+    [self.text getCharacters:buffer range:range];
+    
+    NSUInteger count = 0;
+    AttributeToken* tokens = malloc((end - offset) * sizeof(AttributeToken));
+    for(NSUInteger i = offset; i < end;) {
+        AttributeToken* token = &tokens[count++];
+        NSUInteger start = i;
+        unichar character = buffer[i];
+        if(IsWhitespace(character)) {
+            token->type = kAttributeToken_Whitespace;
+            do {
+                ++i;
+            } while((i < end) && IsWhitespace(buffer[i]));
+        } else if(IsNewline(character)) {
+            token->type = kAttributeToken_Whitespace;
+            i += (character == '\r') && (i + 1 < end) && (buffer[i + 1] == '\n') ? 2 : 1;
+        } else if(character == '=') {
+            token->type = kAttributeToken_Equal;
+            ++i;
+        } else if((character == '\'') || (character == '"')) {
+            do {
+                ++i;
+            } while((i < end) && (buffer[i] != character));
+            if(i < end) {
+                token->type = kAttributeToken_Value;
+                ++i;
+                start += 1;
+                token->range = NSMakeRange(range.location + start, i - 1 - start);
+                continue;
+            }
+            token->type = kAttributeToken_Word;
+        } else {
+            token->type = kAttributeToken_Word;
+            do {
+                ++i;
+            } while((i < end) && !_IsAttributeDelimiter(buffer[i]));
+        }
+        token->range = NSMakeRange(range.location + start, i - start);
+    }
+    free(buffer);
+    
+    //The first token is always skipped since it separates the attributes from the tag name
+    NSString* text = self.text;
+    Class class = [self class];
+    NSMutableDictionary* dictionary = nil;
+    NSUInteger index = _NextAttributeToken(tokens, count, 0);
+    while((index != NSNotFound) && (tokens[index].type != kAttributeToken_Value) && (tokens[index].type != kAttributeToken_Equal)) { //Names cannot be quoted values or "="
+        NSString* name = [text substringWithRange:tokens[index].range];
+        index = _NextAttributeToken(tokens, count, index);
+        if(index == NSNotFound) {
+            break;
+        }
+        NSString* value = @""; //FIXME: Is this the best placeholder?
+        if(tokens[index].type == kAttributeToken_Equal) {
+            index = _NextAttributeToken(tokens, count, index);
+            if(index != NSNotFound) {
+                value = [text substringWithRange:tokens[index].range];
+                index = _NextAttributeToken(tokens, count, index);
+            }
+        }
+        if(dictionary == nil) {
+            dictionary = [[NSMutableDictionary alloc] init];
+        }
+        [dictionary setObject:[class stringWithReplacedEntities:value] forKey:[class stringWithReplacedEntities:name]];
+    }
+    free(tokens);
+    
+    _attributes = dictionary;
+    return _attributes;
+}
+
 @end
 
 @implementation ParserNodeSGMLEntity
 
++ (NSString*) prefixCharacters {
+    return @"&";
+}
+
 + (NSUInteger) isMatchingPrefix:(const unichar*)string maxLength:(NSUInteger)maxLength {
     return *string == '&' ? 1 : NSNotFound;
 }
@@ -271,6 +391,8 @@ PREFIX_SUFFIX_CLASS_IMPLEMENTATION(SGMLCDATA, "<![CDATA[", "]]>")
     return *string == ';' ? 1 : NSNotFound;
 }
 
+TERMINATOR_METHOD(";", 0)
+
 - (NSString*) cleanContent {
     return [ParserLanguageSGML stringWithReplacedEntities:[self.text substringWithRange:self.range]];
 }
@@ -279,10 +401,14 @@ PREFIX_SUFFIX_CLASS_IMPLEMENTATION(SGMLCDATA, "<![CDATA[", "]]>")
 
 @implementation ParserNodeSGMLElement
 
++ (BOOL) isReparseBoundary {
+    return YES;
+}
+
 - (NSString*) cleanContent {
     NSMutableString* string = [NSMutableString string];
     for(ParserNode* node in self.children) {
-        if([node isKindOfClass:[ParserNodeSGMLTag class]] || [node isKindOfClass:[ParserNodeSGMLComment class]]|| [node isKindOfClass:[ParserNodeSGMLCDATA class]]) {
+        if(IS_KIND(node, SGMLTag) || IS_KIND(node, SGMLComment)|| IS_KIND(node, SGMLCDATA)) {
             continue;
         }
         [string appendString:node.cleanContent];
@@ -299,37 +425,3 @@ PREFIX_SUFFIX_CLASS_IMPLEMENTATION(SGMLCDATA, "<![CDATA[", "]]>")
 }
 
 @end
-
-@implementation ParserNodeSGMLValueSingleQuote
-
-+ (NSUInteger) isMatchingPrefix:(const unichar*)string maxLength:(NSUInteger)maxLength {
-    return (*string == '\'') ? 1 : NSNotFound;
-}
-
-+ (NSUInteger) isMatchingSuffix:(const unichar*)string maxLength:(NSUInteger)maxLength {
-    return *string == '\'' ? 1 : NSNotFound;
-}
-
-- (NSString*) cleanContent {
-    NSRange range = self.range;
-    return [self.text substringWithRange:NSMakeRange(range.location + 1, range.length - 2)];
-}
-
-@end
-
-@implementation ParserNodeSGMLValueDoubleQuote
-
-+ (NSUInteger) isMatchingPrefix:(const unichar*)string maxLength:(NSUInteger)maxLength {
-    return (*string == '"') ? 1 : NSNotFound;
-}
-
-+ (NSUInteger) isMatchingSuffix:(const unichar*)string maxLength:(NSUInteger)maxLength {
-    return *string == '"' ? 1 : NSNotFound;
-}
-
-- (NSString*) cleanContent {
-    NSRange range = self.range;
-    return [self.text substringWithRange:NSMakeRange(range.location + 1, range.length - 2)];
-}
-
-@end
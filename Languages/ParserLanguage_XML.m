@@ -16,12 +16,119 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#import <objc/runtime.h>
+
 #import "Parser_Internal.h"
 #import "ParserLanguage_XML.h"
 
 @interface ParserLanguageXML : ParserLanguageSGML
 @end
 
+static unichar _LookupEntity(const unichar* name, NSUInteger length) {
+    static const char* names[] = {"quot", "amp", "apos", "lt", "gt"};
+    static const unichar characters[] = {'"', '&', '\'', '<', '>'};
+    for(NSUInteger i = 0; i < sizeof(names) / sizeof(const char*); ++i) {
+        NSUInteger j = 0;
+        while((j < length) && (names[i][j] == name[j])) {
+            ++j;
+        }
+        if((j == length) && (names[i][j] == 0)) {
+            return characters[i];
+        }
+    }
+    return 0;
+}
+
+typedef struct {
+    Class class;
+    const char* name;
+    NSUInteger length;
+} ElementClassEntry;
+
+/* Open addressing hash table of names which are folded to ASCII lowercase when hashing and comparing if case-insensitive, so that element names are never copied */
+struct ParserElementClassTable {
+    BOOL caseInsensitive;
+    NSUInteger maxLength;
+    NSUInteger mask;
+    ElementClassEntry entries[];
+};
+
+static inline unichar _FoldCharacter(unichar character, BOOL caseInsensitive) {
+    return caseInsensitive && (character >= 'A') && (character <= 'Z') ? character + ('a' - 'A') : character;
+}
+
+static NSUInteger _HashElementName(const unichar* name, NSUInteger length, BOOL caseInsensitive) {
+    NSUInteger hash = 2166136261U; //FNV-1a
+    for(NSUInteger i = 0; i < length; ++i) {
+        hash = (hash ^ _FoldCharacter(name[i], caseInsensitive)) * 16777619U;
+    }
+    return hash;
+}
+
+ParserElementClassTable* _ParserElementClassTableCreate(const ParserElementClassMapping* mappings, BOOL caseInsensitive) {
+    NSUInteger count = 0;
+    while(mappings[count].name) {
+        ++count;
+    }
+    NSUInteger size = 4;
+    while(size < 2 * count) {
+        size *= 2;
+    }
+    ParserElementClassTable* table = calloc(1, sizeof(ParserElementClassTable) + size * sizeof(ElementClassEntry));
+    table->caseInsensitive = caseInsensitive;
+    table->mask = size - 1;
+    for(const ParserElementClassMapping* mapping = mappings; mapping->name; ++mapping) {
+        Class class = objc_getClass(mapping->nodeClass);
+        NSUInteger length = strlen(mapping->name);
+        if((class == Nil) || (length == 0)) {
+            free(table);
+            [NSException raise:NSInternalInconsistencyException format:@"Invalid element class mapping from \"%s\" to \"%s\"", mapping->name, mapping->nodeClass];
+        }
+        unichar name[length];
+        for(NSUInteger i = 0; i < length; ++i) {
+            name[i] = mapping->name[i];
+        }
+        NSUInteger index = _HashElementName(name, length, caseInsensitive) & table->mask;
+        while(table->entries[index].class) {
+            index = (index + 1) & table->mask;
+        }
+        table->entries[index].class = class;
+        table->entries[index].name = mapping->name;
+        table->entries[index].length = length;
+        table->maxLength = MAX(table->maxLength, length);
+    }
+    return table;
+}
+
+void _ParserElementClassTableRelease(ParserElementClassTable* table) {
+    free(table);
+}
+
+Class _ElementClassForName(const ParserElementClassTable* table, NSString* name) {
+    NSUInteger length = name.length;
+    if((length == 0) || (length > table->maxLength)) {
+        return Nil;
+    }
+    
+    unichar buffer[length];
+    [name getCharacters:buffer range:NSMakeRange(0, length)];
+    NSUInteger index = _HashElementName(buffer, length, table->caseInsensitive) & table->mask;
+    while(table->entries[index].class) {
+        const ElementClassEntry* entry = &table->entries[index];
+        if(entry->length == length) {
+            NSUInteger i = 0;
+            while((i < length) && (_FoldCharacter(buffer[i], table->caseInsensitive) == _FoldCharacter(entry->name[i], table->caseInsensitive))) {
+                ++i;
+            }
+            if(i == length) {
+                return entry->class;
+            }
+        }
+        index = (index + 1) & table->mask;
+    }
+    return Nil;
+}
+
 @implementation ParserLanguageXML
 
 /* WARNING: Keep in sync with ParserLanguage_SGML */
@@ -45,21 +152,7 @@
 }
 
 + (NSString*) stringWithReplacedEntities:(NSString*)string {
-    static NSDictionary* entities = nil;
-    if(entities == nil) {
-        entities = [[NSDictionary alloc] initWithObjectsAndKeys:
-            @"&quot;", @"\x22",
-            @"&amp;", @"\x26",
-            @"&apos;", @"\x27",
-            @"&lt;", @"\x3C",
-            @"&gt;", @"\x3E",
-        nil];
-    }
-    NSMutableString* newString = [NSMutableString stringWithString:string];
-    for(NSString* key in entities) {
-        [newString replaceOccurrencesOfString:[entities objectForKey:key] withString:key options:0 range:NSMakeRange(0, newString.length)];
-    }
-    return newString;
+    return _StringWithReplacedEntities(string, _LookupEntity);
 }
 
 + (Class) SGMLElementClass {
@@ -77,6 +170,11 @@
 @end
 
 @implementation ParserNodeXMLTag
+
++ (NSString*) stringWithReplacedEntities:(NSString*)string {
+    return [ParserLanguageXML stringWithReplacedEntities:string];
+}
+
 @end
 
 @implementation ParserNodeXMLComment
@@ -114,6 +212,10 @@ PREFIX_SUFFIX_CLASS_IMPLEMENTATION(XMLProcessingInstructions, "<?", "?>")
     return [NSSet setWithObject:[ParserNodeXMLProcessingInstructions class]];
 }
 
++ (NSString*) stringWithReplacedEntities:(NSString*)string {
+    return [ParserLanguageXML stringWithReplacedEntities:string];
+}
+
 @end
 
 @implementation ParserNodeXMLProcessingInstructions (Internal)
@@ -122,6 +224,10 @@ PREFIX_SUFFIX_CLASS_IMPLEMENTATION(XMLProcessingInstructions, "<?", "?>")
     return [NSSet setWithObject:[ParserNodeXMLTag class]];
 }
 
++ (NSString*) stringWithReplacedEntities:(NSString*)string {
+    return [ParserLanguageXML stringWithReplacedEntities:string];
+}
+
 - (NSString*) cleanContent {
     NSRange range = self.range;
     return [ParserLanguageXML stringWithReplacedEntities:[self.text substringWithRange:NSMakeRange(range.location + 2, range.length - 4)]];
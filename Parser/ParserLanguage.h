@@ -18,7 +18,23 @@
 
 #import "ParserNode.h"
 
-@class ParserNodeRoot;
+@class ParserNodeRoot, ParserFrozenTree;
+
+typedef enum {
+    kParserEventType_Open = 0, //Start of a branch node - "range" is empty
+    kParserEventType_Close, //End of a branch node - "range" covers the entire node and "line" is still the line where it starts
+    kParserEventType_Leaf
+} ParserEventType;
+
+typedef struct {
+    ParserEventType type;
+    Class nodeClass;
+    NSRange range;
+    NSUInteger line; //Zero-based line where the node starts
+    const unichar* characters; //Characters of the whole text being parsed which "range" indexes into - Only valid during the call
+} ParserEvent;
+
+typedef BOOL (*ParserEventFunction)(const ParserEvent* event, void* context); //Return NO to stop parsing
 
 /* Abstract class: do not instantiate */
 @interface ParserLanguage : NSObject <NSCopying> {
@@ -26,11 +42,15 @@
     NSMutableArray* _languageDependencies;
     NSMutableSet* _keywords;
     NSMutableArray* _nodeClasses;
+    void* _syntaxAnalysisFunctions;
 }
 + (NSSet*) allLanguages;
++ (void) setUsesArenaAllocation:(BOOL)flag; //Nodes of parsed trees are allocated in bulk and destroyed together once no longer referenced - Keeping any of them (e.g. after removing it from its tree) keeps them all alive so use -copy instead
++ (BOOL) usesArenaAllocation;
 + (ParserLanguage*) languageWithName:(NSString*)name;
 + (ParserLanguage*) defaultLanguageForFileExtension:(NSString*)extension;
 + (ParserNodeRoot*) parseTextFile:(NSString*)path encoding:(NSStringEncoding)encoding syntaxAnalysis:(BOOL)syntaxAnalysis;
++ (ParserNodeRoot*) parseTextFile:(NSString*)path language:(ParserLanguage*)language encoding:(NSStringEncoding)encoding syntaxAnalysis:(BOOL)syntaxAnalysis; //Pass "-" as the path to read from stdin - ".gz" files are decompressed on the fly - Passing a nil language uses the default one for the file extension
 
 @property(nonatomic, readonly) NSString* name;
 @property(nonatomic, readonly) NSSet* fileExtensions;
@@ -38,15 +58,54 @@
 @property(nonatomic, readonly) NSArray* nodeClasses;
 
 - (ParserNodeRoot*) parseText:(NSString*)text syntaxAnalysis:(BOOL)syntaxAnalysis;
+- (BOOL) parseText:(NSString*)text withEventFunction:(ParserEventFunction)function context:(void*)context; //Reports nodes as they are tokenized without building a tree or performing syntax analysis - Returns NO if parsing failed or was stopped
++ (BOOL) parseTextFile:(NSString*)path language:(ParserLanguage*)language encoding:(NSStringEncoding)encoding withEventFunction:(ParserEventFunction)function context:(void*)context; //Same as above for files read like +parseTextFile:language:encoding:syntaxAnalysis: - UTF-8 files are tokenized from the decoded characters without copying them again
+#if NS_BLOCKS_AVAILABLE
+- (BOOL) parseText:(NSString*)text usingEventBlock:(BOOL (^)(const ParserEvent* event))block;
+#endif
 @end
 
 @interface ParserNodeRoot : ParserNode {
 @private
     ParserLanguage* _language;
+    void* _lineIndex;
 }
 @property(nonatomic, readonly) ParserLanguage* language;
 
+- (BOOL) getLine:(NSUInteger*)line column:(NSUInteger*)column forLocation:(NSUInteger)location; //Line and column are zero-based - Returns NO if "location" is outside of "range"
+
 - (BOOL) writeContentToFile:(NSString*)path encoding:(NSStringEncoding)encoding;
+
+- (ParserFrozenTree*) freeze; //Returns nil if the tree is too large to be frozen
+- (BOOL) reparseWithEditedRange:(NSRange)range replacementText:(NSString*)text; //Updates the tree after the characters in "range" were replaced by "text" reparsing only the smallest enclosing node that allows it - Returns NO if parsing failed in which case the tree is unchanged
+@end
+
+/* Immutable flat copy of a tree which can be shared between threads - Nodes are identified by their depth-first index starting at 0 for the root */
+@interface ParserFrozenTree : NSObject {
+@private
+    NSString* _text;
+    ParserLanguage* _language;
+    NSUInteger _count;
+    Class* _classes;
+    uint32_t* _kinds;
+    uint32_t* _starts;
+    uint32_t* _lengths;
+    uint32_t* _parents;
+    uint32_t* _firstChildren;
+    uint32_t* _nextSiblings;
+}
+@property(nonatomic, readonly) NSString* text; //Content of the tree at the time it was frozen
+@property(nonatomic, readonly) ParserLanguage* language;
+@property(nonatomic, readonly) NSUInteger count;
+
+- (Class) nodeClassAtIndex:(NSUInteger)index;
+- (NSRange) rangeAtIndex:(NSUInteger)index; //Range in "text"
+- (NSString*) contentAtIndex:(NSUInteger)index;
+- (NSUInteger) parentAtIndex:(NSUInteger)index; //Returns NSNotFound for the root
+- (NSUInteger) firstChildAtIndex:(NSUInteger)index; //Returns NSNotFound if none
+- (NSUInteger) nextSiblingAtIndex:(NSUInteger)index; //Returns NSNotFound if none
+
+- (ParserNode*) nodeAtIndex:(NSUInteger)index; //Creates a new mutable tree rooted at this node (a ParserNodeRoot for index 0)
 @end
 
 /* This class cannot have children */
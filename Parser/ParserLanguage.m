@@ -17,11 +17,250 @@
 */
 
 #import <objc/runtime.h>
+#import <zlib.h>
+#if defined(__AVX2__)
+#import <immintrin.h>
+#elif defined(__SSE2__)
+#import <emmintrin.h>
+#endif
 
 #import "Parser_Internal.h"
 
 #define ParserLanguagePrefix "ParserLanguage"
 
+#define ParserNodePrefix "ParserNode"
+
+#define kDispatchTableSize 128 //Characters past this value all share the last entry of the dispatch tables
+#define kKeywordTableMaxSeeds 4096
+#define kSkipSetMaxVectorCharacters 8
+#define kLineIndexChunkSize 4096
+
+#define IsIdentifierCharacter(C) (IsAlphaNumerical(C) || (C == '_'))
+#define IsIdentifierStart(S) ((*(S) == '@') || (*(S) == '#') || (IsIdentifierCharacter(*(S)) && !IsIdentifierCharacter(*((S) - 1))))
+
+typedef NSUInteger (*PrefixMethod)(id self, SEL cmd, const unichar* string, NSUInteger maxLength);
+
+typedef struct {
+    BOOL enabled;
+    uint64_t bits[2]; //ASCII characters that can start a token or close the current parent
+    NSUInteger count;
+    unichar characters[kSkipSetMaxVectorCharacters]; //Only valid if "count" is not greater than kSkipSetMaxVectorCharacters
+} SkipSet;
+
+typedef struct {
+    const ParserNodeTerminator* terminator;
+    NSUInteger length;
+    SkipSet skipSet; //First terminator character and escape character
+} TerminatorEntry;
+
+typedef struct {
+    Class nodeClass;
+    PrefixMethod method; //Cached implementation of +isMatchingPrefix:maxLength: or NULL for keywords
+    const SkipSet* skipSet; //Characters to stop at while a node of this class is opened
+    const TerminatorEntry* terminator; //NULL if the suffix must be found with +isMatchingSuffix:maxLength:
+} DispatchEntry;
+
+typedef struct KeywordEntry {
+    Class nodeClass;
+    const ParserNodeKeywordDefinition* definition;
+    NSUInteger length;
+    const struct KeywordEntry* next; //Next node class with the same keyword in "nodeClasses" order
+} KeywordEntry;
+
+typedef struct {
+    NSUInteger counts[kDispatchTableSize + 1];
+    DispatchEntry* entries[kDispatchTableSize + 1]; //Candidate node classes for each leading character in "nodeClasses" order
+    NSUInteger keywordCounts[kDispatchTableSize + 1];
+    KeywordEntry* keywords; //Perfect hash table of keywords
+    KeywordEntry* chainedKeywords; //Node classes with the same keyword as an earlier one
+    NSUInteger keywordMask;
+    NSUInteger keywordSeed;
+    NSUInteger keywordMaxLength;
+    SkipSet rootSkipSet;
+    SkipSet* skipSets; //One per node class in "nodeClasses" order
+    TerminatorEntry* terminators; //One per node class in "nodeClasses" order
+} DispatchTable;
+
+static CFMutableDictionaryRef _dispatchTables = NULL;
+static NSMutableDictionary* _keywordClasses = nil;
+static BOOL _arenaAllocation = NO;
+
+static inline NSUInteger _HashCharacter(NSUInteger hash, unichar character) {
+    return (hash ^ character) * 16777619;
+}
+
+static BOOL _IsValidKeyword(const char* characters) {
+    if((*characters == '@') || (*characters == '#')) {
+        ++characters;
+    }
+    if(*characters == 0) {
+        return NO;
+    }
+    while(*characters) {
+        if(!IsIdentifierCharacter(*characters)) {
+            return NO;
+        }
+        ++characters;
+    }
+    return YES;
+}
+
+static void _PaddedBufferDeallocate(void* ptr, void* info) {
+    free((unichar*)ptr - 1);
+}
+
+/* Decodes UTF-8 directly into a zero-padded UTF-16 buffer which is then used as the backing store of the returned string whenever possible (avoiding an extra copy of the text for the tokenizer) */
+static NSString* _NewStringWithPaddedBufferFromUTF8(const unsigned char* bytes, NSUInteger length, const unichar** textBuffer) {
+    static CFAllocatorRef deallocator = NULL;
+    if(deallocator == NULL) {
+        CFAllocatorContext context = {0, NULL, NULL, NULL, NULL, NULL, NULL, _PaddedBufferDeallocate, NULL};
+        CFAllocatorRef newDeallocator = CFAllocatorCreate(kCFAllocatorDefault, &context);
+        if(!__sync_bool_compare_and_swap(&deallocator, NULL, newDeallocator)) { //Texts can be decoded on multiple threads
+            CFRelease(newDeallocator);
+        }
+    }
+    
+    if((length >= 3) && (bytes[0] == 0xEF) && (bytes[1] == 0xBB) && (bytes[2] == 0xBF)) {
+        bytes += 3;
+        length -= 3;
+    }
+    unichar* buffer = malloc((length + 2) * sizeof(unichar)); //UTF-16 never needs more code units than UTF-8 bytes
+    unichar* characters = buffer + 1;
+    const unsigned char* end = bytes + length;
+    BOOL valid = YES;
+    while(bytes < end) {
+        uint64_t word;
+        if((end - bytes >= 8) && (memcpy(&word, bytes, 8), !(word & 0x8080808080808080ULL))) {
+            for(NSUInteger i = 0; i < 8; ++i) {
+                *characters++ = *bytes++;
+            }
+            continue;
+        }
+        
+        UInt32 character = *bytes++;
+        if(character < 0x80) {
+            *characters++ = character;
+            continue;
+        }
+        NSUInteger count;
+        UInt32 minimum;
+        if((character & 0xE0) == 0xC0) {
+            count = 1;
+            minimum = 0x80;
+            character &= 0x1F;
+        } else if((character & 0xF0) == 0xE0) {
+            count = 2;
+            minimum = 0x800;
+            character &= 0x0F;
+        } else if((character & 0xF8) == 0xF0) {
+            count = 3;
+            minimum = 0x10000;
+            character &= 0x07;
+        } else {
+            valid = NO;
+            break;
+        }
+        if(end - bytes < count) {
+            valid = NO;
+            break;
+        }
+        while(count) {
+            if((*bytes & 0xC0) != 0x80) {
+                break;
+            }
+            character = (character << 6) | (*bytes++ & 0x3F);
+            --count;
+        }
+        if(count || (character < minimum) || (character > 0x10FFFF) || ((character >= 0xD800) && (character <= 0xDFFF))) {
+            valid = NO;
+            break;
+        }
+        if(character >= 0x10000) {
+            character -= 0x10000;
+            *characters++ = 0xD800 + (character >> 10);
+            *characters++ = 0xDC00 + (character & 0x3FF);
+        } else {
+            *characters++ = character;
+        }
+    }
+    if(!valid) {
+        NSLog(@"Invalid UTF-8 text");
+        free(buffer);
+        return nil;
+    }
+    
+    length = characters - (buffer + 1);
+    buffer[0] = 0x0000;
+    buffer[length + 1] = 0x0000;
+    NSString* string = (NSString*)CFStringCreateWithCharactersNoCopy(kCFAllocatorDefault, buffer + 1, length, deallocator);
+    *textBuffer = CFStringGetCharactersPtr((CFStringRef)string) == buffer + 1 ? buffer + 1 : NULL; //CFString may have chosen to copy the characters
+    return string;
+}
+
+static ParserNodeRoot* _NewNodeTreeFromBuffer(id self, NSString* text, const unichar* textBuffer, NSArray* nodeClasses, BOOL syntaxAnalysis);
+
+//Node classes created through KEYWORD_CLASS_IMPLEMENTATION() indexed by "language:keyword"
+static NSDictionary* _KeywordClasses() {
+    @synchronized([ParserLanguage class]) {
+        if(_keywordClasses == nil) {
+            _keywordClasses = [[NSMutableDictionary alloc] init];
+            int count = objc_getClassList(NULL, 0);
+            if(count > 0) {
+                Class* list = malloc(count * sizeof(Class));
+                count = objc_getClassList(list, count);
+                for(int i = 0; i < count; ++i) {
+                    if(strncmp(class_getName(list[i]), ParserNodePrefix, sizeof(ParserNodePrefix) - 1) == 0) {
+                        if((list[i] != [ParserNodeKeyword class]) && [list[i] isSubclassOfClass:[ParserNodeKeyword class]]) {
+                            const ParserNodeKeywordDefinition* definition = [list[i] keywordDefinition];
+                            if(definition && definition->language) {
+                                [_keywordClasses setObject:list[i] forKey:[NSString stringWithFormat:@"%s:%s", definition->language, definition->characters]];
+                            }
+                        }
+                    }
+                }
+                free(list);
+            }
+        }
+    }
+    return _keywordClasses;
+}
+
+//Reads from stdin if "path" is "-", decompresses the file on the fly if "path" has a ".gz" extension or memory-maps it otherwise
+static NSData* _NewDataWithContentsOfInput(NSString* path) {
+    if([path isEqualToString:@"-"]) {
+        return [[[NSFileHandle fileHandleWithStandardInput] readDataToEndOfFile] retain];
+    }
+    
+    if([[path pathExtension] caseInsensitiveCompare:@"gz"] == NSOrderedSame) {
+        gzFile file = gzopen([path fileSystemRepresentation], "rb");
+        if(file == NULL) {
+            return nil;
+        }
+        NSMutableData* data = [[NSMutableData alloc] initWithLength:(64 * 1024)];
+        NSUInteger length = 0;
+        while(1) {
+            if(data.length - length < 64 * 1024) {
+                [data setLength:(data.length * 2)];
+            }
+            int count = gzread(file, (char*)data.mutableBytes + length, (unsigned)MIN(data.length - length, 1024 * 1024)); //gzread() cannot read more than INT_MAX bytes at once
+            if(count <= 0) {
+                if(count < 0) {
+                    NSLog(@"Failed decompressing \"%@\"", path);
+                    [data release];
+                    data = nil;
+                }
+                break;
+            }
+            length += count;
+        }
+        gzclose(file);
+        [data setLength:length];
+        return data;
+    }
+    
+    return [[NSData alloc] initWithContentsOfFile:path options:NSMappedRead error:NULL];
+}
+
 @implementation ParserLanguage
 
 + (id) allocWithZone:(NSZone*)zone {
@@ -53,6 +292,14 @@
     return set;
 }
 
++ (void) setUsesArenaAllocation:(BOOL)flag {
+    _arenaAllocation = flag;
+}
+
++ (BOOL) usesArenaAllocation {
+    return _arenaAllocation;
+}
+
 + (ParserLanguage*) languageWithName:(NSString*)name {
     for(ParserLanguage* language in [ParserLanguage allLanguages]) {
         if([[language name] caseInsensitiveCompare:name] == NSOrderedSame) {
@@ -73,12 +320,48 @@
 }
 
 + (ParserNodeRoot*) parseTextFile:(NSString*)path encoding:(NSStringEncoding)encoding syntaxAnalysis:(BOOL)syntaxAnalysis {
-    NSString* string = [[NSString alloc] initWithContentsOfFile:path encoding:encoding error:NULL];
-    if(string == nil) {
+    return [self parseTextFile:path language:nil encoding:encoding syntaxAnalysis:syntaxAnalysis];
+}
+
+static ParserLanguage* _DefaultLanguageForPath(NSString* path) {
+    NSString* extension = [path pathExtension];
+    if([extension caseInsensitiveCompare:@"gz"] == NSOrderedSame) {
+        extension = [[path stringByDeletingPathExtension] pathExtension];
+    }
+    return [ParserLanguage defaultLanguageForFileExtension:extension];
+}
+
++ (ParserNodeRoot*) parseTextFile:(NSString*)path language:(ParserLanguage*)language encoding:(NSStringEncoding)encoding syntaxAnalysis:(BOOL)syntaxAnalysis {
+    if(language == nil) {
+        language = _DefaultLanguageForPath(path);
+    }
+    NSData* data = _NewDataWithContentsOfInput(path);
+    if(data == nil) {
         return nil;
     }
-    ParserNodeRoot* root = [[self defaultLanguageForFileExtension:[path pathExtension]] parseText:string syntaxAnalysis:syntaxAnalysis];
-    [string release];
+    ParserNodeRoot* root;
+    if(encoding == NSUTF8StringEncoding) {
+        const unichar* buffer;
+        NSString* string = _NewStringWithPaddedBufferFromUTF8(data.bytes, data.length, &buffer); //Reads straight from the file mapping
+        [data release];
+        if(string == nil) {
+            return nil;
+        }
+        if(buffer) {
+            root = [_NewNodeTreeFromBuffer(language, string, buffer, nil, syntaxAnalysis) autorelease];
+        } else {
+            root = [language parseText:string syntaxAnalysis:syntaxAnalysis];
+        }
+        [string release];
+    } else {
+        NSString* string = [[NSString alloc] initWithData:data encoding:encoding];
+        [data release];
+        if(string == nil) {
+            return nil;
+        }
+        root = [language parseText:string syntaxAnalysis:syntaxAnalysis];
+        [string release];
+    }
     return root;
 }
 
@@ -98,10 +381,21 @@
     return 1;
 }
 
++ (BOOL) languageAllowsReparseBoundary:(Class)nodeClass {
+    return YES;
+}
+
++ (const ParserSyntaxAnalysisRule*) languageSyntaxAnalysisRules {
+    return NULL;
+}
+
 - (void) dealloc {
     [_languageDependencies release];
     [_keywords release];
     [_nodeClasses release];
+    if(_syntaxAnalysisFunctions) {
+        free(_syntaxAnalysisFunctions);
+    }
     
     [super dealloc];
 }
@@ -153,9 +447,10 @@
         [_nodeClasses addObject:[ParserNodeMatch class]]; //Special-cased by parser
         for(ParserLanguage* language in self.allLanguageDependencies) {
             NSString* prefix = [NSStringFromClass([language class]) substringFromIndex:[@ParserLanguagePrefix length]];
+            NSDictionary* keywordClasses = _KeywordClasses();
             for(NSString* keyword in [[language class] languageReservedKeywords]) {
-                Class class = NSClassFromString([NSString stringWithFormat:@"ParserNode%@%@%@", prefix, [[keyword substringToIndex:1]uppercaseString], [keyword substringFromIndex:1]]);
-                if(class) {
+                Class class = [keywordClasses objectForKey:[NSString stringWithFormat:@"%@:%@", prefix, keyword]];
+                if(class && ![_nodeClasses containsObject:class]) {
                     [_nodeClasses addObject:class];
                 }
             }
@@ -184,107 +479,473 @@
     return _nodeClasses;
 }
 
-+ (ParserNodeRoot*) newNodeTreeFromText:(NSString*)text range:(NSRange)range textBuffer:(const unichar*)textBuffer withNodeClasses:(NSArray*)nodeClasses {
-    ParserNodeRoot* rootNode = [[ParserNodeRoot alloc] initWithText:text range:range];
-    if(rootNode == nil) {
-        return nil;
+static Class _ImplementingClass(Class class, SEL selector) {
+    IMP method = method_getImplementation(class_getClassMethod(class, selector));
+    Class superclass = class_getSuperclass(class);
+    while(superclass && (method_getImplementation(class_getClassMethod(superclass, selector)) == method)) {
+        class = superclass;
+        superclass = class_getSuperclass(class);
+    }
+    return class;
+}
+
+static BOOL _BuildKeywordTable(DispatchTable* table, KeywordEntry* keywords, NSUInteger count, NSUInteger size, NSUInteger seed) {
+    KeywordEntry* entries = calloc(size, sizeof(KeywordEntry));
+    for(NSUInteger i = 0; i < count; ++i) {
+        NSUInteger hash = seed;
+        for(const char* characters = keywords[i].definition->characters; *characters; ++characters) {
+            hash = _HashCharacter(hash, *characters);
+        }
+        KeywordEntry* entry = &entries[hash & (size - 1)];
+        if(entry->nodeClass) {
+            free(entries);
+            return NO;
+        }
+        *entry = keywords[i];
+    }
+    table->keywords = entries;
+    table->keywordMask = size - 1;
+    table->keywordSeed = seed;
+    return YES;
+}
+
+static Class _LookupKeyword(const DispatchTable* table, const unichar* string, NSUInteger maxLength, NSUInteger* length) {
+    NSUInteger hash = table->keywordSeed;
+    const unichar* end = string;
+    if((*end == '@') || (*end == '#')) {
+        hash = _HashCharacter(hash, *end++);
+    }
+    while(IsIdentifierCharacter(*end)) { //The text buffer is zero-padded so this always stops
+        if(end - string == table->keywordMaxLength) {
+            return Nil; //Keywords must match whole identifiers
+        }
+        hash = _HashCharacter(hash, *end++);
     }
     
-    NSMutableArray* stack = [NSMutableArray array];
-    [stack addObject:rootNode];
-    NSUInteger lastLine = 0;
-    NSUInteger currentLine = 0;
+    const KeywordEntry* entry = &table->keywords[hash & table->keywordMask];
+    if((entry->nodeClass == Nil) || (entry->length != end - string) || !_EqualsCharacters(string, entry->definition->characters, entry->length)) {
+        return Nil;
+    }
+    for(; entry; entry = entry->next) { //Like the prefix matching, fall back to the next node class if the trailing character is rejected
+        const ParserNodeKeywordDefinition* definition = entry->definition;
+        if(definition->trailingWhitespaceOrNewline || definition->trailingCharacters) {
+            if((maxLength <= entry->length) || !((definition->trailingWhitespaceOrNewline && IsWhitespaceOrNewline(*end)) || (definition->trailingCharacters && _IsCharacterInSet(*end, definition->trailingCharacters, strlen(definition->trailingCharacters))))) {
+                continue;
+            }
+        } else if(maxLength < entry->length) {
+            continue;
+        }
+        *length = entry->length;
+        return entry->nodeClass;
+    }
+    return Nil;
+}
+
+static void _AddSkipSetCharacter(SkipSet* set, unichar character) {
+    if(!(set->bits[character >> 6] & (1ULL << (character & 63)))) {
+        set->bits[character >> 6] |= 1ULL << (character & 63);
+        if(set->count < kSkipSetMaxVectorCharacters) {
+            set->characters[set->count] = character;
+        }
+        ++set->count;
+    }
+}
+
+//Returns the number of characters at the start of "string" that cannot start a prefix or suffix match
+static inline NSUInteger _SkipCharacters(const SkipSet* set, const unichar* string, NSUInteger maxLength) {
+    NSUInteger length = 0;
+#if defined(__AVX2__) || defined(__SSE2__)
+    if(set->count <= kSkipSetMaxVectorCharacters) {
+#if defined(__AVX2__)
+        __m256i vectors[kSkipSetMaxVectorCharacters];
+        for(NSUInteger i = 0; i < set->count; ++i) {
+            vectors[i] = _mm256_set1_epi16(set->characters[i]);
+        }
+        while(length + 16 <= maxLength) {
+            __m256i block = _mm256_loadu_si256((const __m256i*)(string + length));
+            __m256i matches = _mm256_setzero_si256();
+            for(NSUInteger i = 0; i < set->count; ++i) {
+                matches = _mm256_or_si256(matches, _mm256_cmpeq_epi16(block, vectors[i]));
+            }
+            unsigned int mask = _mm256_movemask_epi8(matches);
+            if(mask) {
+                return length + __builtin_ctz(mask) / 2;
+            }
+            length += 16;
+        }
+#else
+        __m128i vectors[kSkipSetMaxVectorCharacters];
+        for(NSUInteger i = 0; i < set->count; ++i) {
+            vectors[i] = _mm_set1_epi16(set->characters[i]);
+        }
+        while(length + 8 <= maxLength) {
+            __m128i block = _mm_loadu_si128((const __m128i*)(string + length));
+            __m128i matches = _mm_setzero_si128();
+            for(NSUInteger i = 0; i < set->count; ++i) {
+                matches = _mm_or_si128(matches, _mm_cmpeq_epi16(block, vectors[i]));
+            }
+            unsigned int mask = _mm_movemask_epi8(matches);
+            if(mask) {
+                return length + __builtin_ctz(mask) / 2;
+            }
+            length += 8;
+        }
+#endif
+    }
+#endif
+    while(length < maxLength) {
+        unichar character = string[length];
+        if((character < 128) && (set->bits[character >> 6] & (1ULL << (character & 63)))) {
+            break;
+        }
+        ++length;
+    }
+    return length;
+}
+
+//Returns the offset of the terminator in "string" or NSNotFound
+static NSUInteger _FindTerminator(const TerminatorEntry* entry, const unichar* string, NSUInteger maxLength) {
+    const ParserNodeTerminator* terminator = entry->terminator;
+    NSUInteger length = 0;
+    while(length < maxLength) {
+        length += _SkipCharacters(&entry->skipSet, string + length, maxLength - length);
+        if(length >= maxLength) {
+            break;
+        }
+        if(terminator->escapeCharacter && (string[length] == terminator->escapeCharacter)) {
+            length += 2;
+            continue;
+        }
+        if((maxLength - length >= entry->length) && _EqualsCharacters(string + length, terminator->characters, entry->length)) {
+            return length;
+        }
+        ++length;
+    }
+    return NSNotFound;
+}
+
+static void _AddDispatchEntry(DispatchTable* table, NSUInteger index, Class nodeClass, PrefixMethod method, const SkipSet* skipSet, const TerminatorEntry* terminator) {
+    NSUInteger count = table->counts[index];
+    if(count && (table->entries[index][count - 1].nodeClass == nodeClass)) {
+        return;
+    }
+    table->entries[index][count].nodeClass = nodeClass;
+    table->entries[index][count].method = method;
+    table->entries[index][count].skipSet = skipSet;
+    table->entries[index][count].terminator = terminator;
+    table->counts[index] = count + 1;
+    if(method == NULL) {
+        table->keywordCounts[index] += 1;
+    }
+}
+
+static DispatchTable* _NewDispatchTable(NSArray* nodeClasses) {
+    DispatchTable* table = calloc(1, sizeof(DispatchTable));
+    for(NSUInteger i = 0; i <= kDispatchTableSize; ++i) {
+        table->entries[i] = malloc(nodeClasses.count * sizeof(DispatchEntry));
+    }
+    table->skipSets = calloc(nodeClasses.count, sizeof(SkipSet));
+    table->terminators = calloc(nodeClasses.count, sizeof(TerminatorEntry));
+    KeywordEntry* keywords = malloc(nodeClasses.count * sizeof(KeywordEntry));
+    NSUInteger keywordCount = 0;
+    table->chainedKeywords = malloc(nodeClasses.count * sizeof(KeywordEntry)); //Never reallocated since chained entries point into it
+    NSUInteger chainedKeywordCount = 0;
+    NSUInteger classIndex = 0;
+    for(Class nodeClass in nodeClasses) {
+        SkipSet* skipSet = &table->skipSets[classIndex];
+        TerminatorEntry* terminator = &table->terminators[classIndex];
+        ++classIndex;
+        if((nodeClass == [ParserNodeText class]) || (nodeClass == [ParserNodeMatch class])) {
+            continue;
+        }
+        Class prefixClass = _ImplementingClass(nodeClass, @selector(isMatchingPrefix:maxLength:));
+        if(prefixClass == [ParserNode class]) {
+            continue; //Node class is never matched by the parser
+        }
+        PrefixMethod method = (PrefixMethod)[nodeClass methodForSelector:@selector(isMatchingPrefix:maxLength:)];
+        
+        //Only trust the prefix characters and keyword if they were not inherited from a superclass with a different prefix matching
+        NSString* characters = nil;
+        if([_ImplementingClass(nodeClass, @selector(prefixCharacters)) isSubclassOfClass:prefixClass]) {
+            characters = [nodeClass prefixCharacters];
+        }
+        if([_ImplementingClass(nodeClass, @selector(keywordDefinition)) isSubclassOfClass:prefixClass]) {
+            const ParserNodeKeywordDefinition* definition = [nodeClass keywordDefinition];
+            if(definition && _IsValidKeyword(definition->characters)) {
+                NSUInteger i;
+                for(i = 0; i < keywordCount; ++i) {
+                    if(strcmp(keywords[i].definition->characters, definition->characters) == 0) {
+                        break;
+                    }
+                }
+                KeywordEntry* entry;
+                if(i < keywordCount) {
+                    const KeywordEntry** next = &keywords[i].next; //Chain node classes sharing a keyword so they are tried in order
+                    while(*next) {
+                        next = &(*next)->next;
+                    }
+                    entry = &table->chainedKeywords[chainedKeywordCount++];
+                    *next = entry;
+                } else {
+                    entry = &keywords[keywordCount++];
+                }
+                entry->nodeClass = nodeClass;
+                entry->definition = definition;
+                entry->length = strlen(definition->characters);
+                entry->next = NULL;
+                table->keywordMaxLength = MAX(table->keywordMaxLength, entry->length);
+                method = NULL;
+                characters = [NSString stringWithFormat:@"%c", definition->characters[0]];
+            }
+        }
+        
+        //Only trust the terminator if it was not inherited from a superclass with a different suffix matching
+        terminator->terminator = NULL;
+        if([nodeClass isAtomic] && [_ImplementingClass(nodeClass, @selector(terminator)) isSubclassOfClass:_ImplementingClass(nodeClass, @selector(isMatchingSuffix:maxLength:))]) {
+            const ParserNodeTerminator* definition = [nodeClass terminator];
+            if(definition && definition->characters[0] && ((unsigned char)definition->characters[0] < 128) && (definition->escapeCharacter < 128)) {
+                terminator->terminator = definition;
+                terminator->length = strlen(definition->characters);
+                terminator->skipSet.enabled = YES;
+                _AddSkipSetCharacter(&terminator->skipSet, definition->characters[0]);
+                if(definition->escapeCharacter) {
+                    _AddSkipSetCharacter(&terminator->skipSet, definition->escapeCharacter);
+                }
+            }
+        }
+        
+        if(characters) {
+            for(NSUInteger i = 0; i < characters.length; ++i) {
+                unichar character = [characters characterAtIndex:i];
+                _AddDispatchEntry(table, character < kDispatchTableSize ? character : kDispatchTableSize, nodeClass, method, skipSet, terminator->terminator ? terminator : NULL);
+            }
+        } else {
+            for(NSUInteger i = 0; i <= kDispatchTableSize; ++i) {
+                _AddDispatchEntry(table, i, nodeClass, method, skipSet, terminator->terminator ? terminator : NULL);
+            }
+        }
+    }
+    if(keywordCount) {
+        NSUInteger size = 8;
+        while(size < 8 * keywordCount) {
+            size *= 2;
+        }
+        while(1) {
+            NSUInteger seed;
+            for(seed = 0; seed < kKeywordTableMaxSeeds; ++seed) {
+                if(_BuildKeywordTable(table, keywords, keywordCount, size, 2166136261U + seed)) {
+                    break;
+                }
+            }
+            if(seed < kKeywordTableMaxSeeds) {
+                break;
+            }
+            size *= 2;
+        }
+    }
+    free(keywords);
+    
+    //Raw text can only be skipped over if all node classes declare their prefix characters and these are all ASCII
+    if(table->counts[kDispatchTableSize] == 0) {
+        table->rootSkipSet.enabled = YES;
+        for(unichar i = 0; i < kDispatchTableSize; ++i) {
+            if(table->counts[i]) {
+                _AddSkipSetCharacter(&table->rootSkipSet, i);
+            }
+        }
+    }
+    classIndex = 0;
+    for(Class nodeClass in nodeClasses) {
+        SkipSet* skipSet = &table->skipSets[classIndex++];
+        if(!table->rootSkipSet.enabled || [nodeClass isAtomic]) {
+            continue;
+        }
+        NSString* characters = nil;
+        if([_ImplementingClass(nodeClass, @selector(suffixCharacters)) isSubclassOfClass:_ImplementingClass(nodeClass, @selector(isMatchingSuffix:maxLength:))]) {
+            characters = [nodeClass suffixCharacters];
+        }
+        if(characters) {
+            *skipSet = table->rootSkipSet;
+            for(NSUInteger i = 0; i < characters.length; ++i) {
+                unichar character = [characters characterAtIndex:i];
+                if(character >= 128) {
+                    skipSet->enabled = NO;
+                    break;
+                }
+                _AddSkipSetCharacter(skipSet, character);
+            }
+        }
+    }
+    
+    return table;
+}
+
+//Dispatch tables are built once per node classes array which must not be mutated afterwards
+static const DispatchTable* _DispatchTableForNodeClasses(NSArray* nodeClasses) {
+    DispatchTable* table;
+    @synchronized([ParserLanguage class]) {
+        if(_dispatchTables == NULL) {
+            CFDictionaryKeyCallBacks callbacks = kCFTypeDictionaryKeyCallBacks;
+            callbacks.equal = NULL; //Compare arrays by pointer
+            callbacks.hash = NULL;
+            _dispatchTables = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &callbacks, NULL);
+        }
+        table = (DispatchTable*)CFDictionaryGetValue(_dispatchTables, nodeClasses);
+        if(table == NULL) {
+            table = _NewDispatchTable(nodeClasses);
+            CFDictionarySetValue(_dispatchTables, nodeClasses, table);
+        }
+    }
+    return table;
+}
+
+typedef struct {
+    Class nodeClass;
+    NSUInteger location;
+    NSUInteger line;
+    const SkipSet* skipSet;
+} OpenedNode;
+
+static const SkipSet _newlineSkipSet = {YES, {(1ULL << '\n') | (1ULL << '\r'), 0}, 2, {'\n', '\r'}};
+
+//Line breaks are "\n" or "\r" not followed by "\n"
+static NSUInteger _CountLineBreaksInBuffer(const unichar* buffer, NSUInteger length) {
+    NSUInteger count = 0;
+    NSUInteger location = 0;
+    while(1) {
+        location += _SkipCharacters(&_newlineSkipSet, buffer + location, length - location);
+        if(location == length) {
+            break;
+        }
+        if((buffer[location] == '\n') || (buffer[location + 1] != '\n')) {
+            ++count;
+        }
+        ++location;
+    }
+    return count;
+}
+
+static inline BOOL _SendEvent(ParserEventFunction function, void* context, const unichar* textBuffer, ParserEventType type, Class nodeClass, NSUInteger location, NSUInteger length, NSUInteger line) {
+    ParserEvent event = {type, nodeClass, {location, length}, line, textBuffer};
+    return (*function)(&event, context);
+}
+
+/* Core tokenizer: only keeps track of the currently opened nodes and reports tokens as events - Returns NO on failure or if "function" returned NO */
+static BOOL _TokenizeText(const unichar* textBuffer, NSRange range, const DispatchTable* table, BOOL trackLines, ParserEventFunction function, void* context) {
+    BOOL success = NO;
+    NSUInteger capacity = 32;
+    OpenedNode* stack = malloc(capacity * sizeof(OpenedNode));
+    NSUInteger depth = 0;
+    const SkipSet* skipSet = &table->rootSkipSet;
+    NSUInteger lineLocation = range.location;
+    NSUInteger line = trackLines ? 0 : NSNotFound;
     NSUInteger rawLength = 0;
     while(range.length) {
-        if(stack.count > 1) {
-            ParserNode* parentNode = [stack lastObject];
+        if(depth) {
+            OpenedNode* parent = &stack[depth - 1];
             NSUInteger suffixLength;
-            suffixLength = [[parentNode class] isMatchingSuffix:(textBuffer + range.location + rawLength) maxLength:(range.length - rawLength)];
+            suffixLength = [parent->nodeClass isMatchingSuffix:(textBuffer + range.location + rawLength) maxLength:(range.length - rawLength)];
             if(suffixLength != NSNotFound) {
                 if(rawLength > 0) {
-                    for(NSUInteger i = 0; i < rawLength; ++i) {
-                        if((*(textBuffer + range.location + i) == '\n') || ((*(textBuffer + range.location + i) == '\r') && (*(textBuffer + range.location + i + 1) != '\n'))) {
-                            ++currentLine;
-                        }
+                    if(trackLines) {
+                        line += _CountLineBreaksInBuffer(textBuffer + lineLocation, range.location - lineLocation);
+                        lineLocation = range.location;
+                    }
+                    if(!_SendEvent(function, context, textBuffer, kParserEventType_Leaf, [ParserNodeText class], range.location, rawLength, line)) {
+                        goto Exit;
                     }
-                    
-                    ParserNode* node = [[ParserNodeText alloc] initWithText:text range:NSMakeRange(range.location, rawLength)];
-                    node.lines = NSMakeRange(lastLine, currentLine - lastLine + 1);
-                    lastLine = currentLine;
-                    [parentNode addChild:node];
-                    [node release];
                     
                     range.location += rawLength;
                     range.length -= rawLength;
                     rawLength = 0;
                 }
                 
-                parentNode.range = NSMakeRange(parentNode.range.location, range.location + suffixLength - parentNode.range.location);
-                
                 if(suffixLength > 0) {
-                    for(NSUInteger i = 0; i < suffixLength; ++i) {
-                        if((*(textBuffer + range.location + i) == '\n') || ((*(textBuffer + range.location + i) == '\r') && (*(textBuffer + range.location + i + 1) != '\n'))) {
-                            ++currentLine;
-                        }
+                    if(trackLines) {
+                        line += _CountLineBreaksInBuffer(textBuffer + lineLocation, range.location - lineLocation);
+                        lineLocation = range.location;
+                    }
+                    if(!_SendEvent(function, context, textBuffer, kParserEventType_Leaf, [ParserNodeMatch class], range.location, suffixLength, line)) {
+                        goto Exit;
                     }
-                    
-                    ParserNode* node = [[ParserNodeMatch alloc] initWithText:text range:NSMakeRange(parentNode.range.location + parentNode.range.length - suffixLength, suffixLength)];
-                    node.lines = NSMakeRange(lastLine, currentLine - lastLine + 1);
-                    lastLine = currentLine;
-                    [parentNode addChild:node];
-                    [node release];
                 }
                 
-                parentNode.lines = NSMakeRange(parentNode.lines.location, currentLine - parentNode.lines.location + 1);
-                
-                [stack removeLastObject];
+                if(!_SendEvent(function, context, textBuffer, kParserEventType_Close, parent->nodeClass, parent->location, range.location + suffixLength - parent->location, parent->line)) {
+                    goto Exit;
+                }
+                --depth;
+                skipSet = depth ? stack[depth - 1].skipSet : &table->rootSkipSet;
                 range.location += suffixLength;
                 range.length -= suffixLength;
                 continue;
             }
         }
         
-        Class prefixClass;
-        NSUInteger prefixLength;
-        for(prefixClass in nodeClasses) {
-            if((prefixClass == [ParserNodeText class]) || (prefixClass == [ParserNodeMatch class])) {
-                continue;
+        const unichar* string = textBuffer + range.location + rawLength;
+        NSUInteger index = *string < kDispatchTableSize ? *string : kDispatchTableSize;
+        const DispatchEntry* entry = table->entries[index];
+        Class keywordClass = Nil;
+        NSUInteger keywordLength = 0;
+        if(table->keywordCounts[index] && IsIdentifierStart(string)) {
+            keywordClass = _LookupKeyword(table, string, range.length - rawLength, &keywordLength);
+        }
+        Class prefixClass = Nil;
+        NSUInteger prefixLength = NSNotFound;
+        const SkipSet* prefixSkipSet = NULL;
+        const TerminatorEntry* prefixTerminator = NULL;
+        for(NSUInteger i = 0; i < table->counts[index]; ++i, ++entry) {
+            if(entry->method) {
+                prefixLength = entry->method(entry->nodeClass, @selector(isMatchingPrefix:maxLength:), string, range.length - rawLength);
+            } else {
+                prefixLength = entry->nodeClass == keywordClass ? keywordLength : NSNotFound;
             }
-            prefixLength = [prefixClass isMatchingPrefix:(textBuffer + range.location + rawLength) maxLength:(range.length - rawLength)];
             if(prefixLength != NSNotFound) {
+                prefixClass = entry->nodeClass;
+                prefixSkipSet = entry->skipSet;
+                prefixTerminator = entry->terminator;
                 break;
             }
         }
         if(prefixClass) {
             if(rawLength > 0) {
-                for(NSUInteger i = 0; i < rawLength; ++i) {
-                    if((*(textBuffer + range.location + i) == '\n') || ((*(textBuffer + range.location + i) == '\r') && (*(textBuffer + range.location + i + 1) != '\n'))) {
-                        ++currentLine;
-                    }
+                if(trackLines) {
+                    line += _CountLineBreaksInBuffer(textBuffer + lineLocation, range.location - lineLocation);
+                    lineLocation = range.location;
+                }
+                if(!_SendEvent(function, context, textBuffer, kParserEventType_Leaf, [ParserNodeText class], range.location, rawLength, line)) {
+                    goto Exit;
                 }
-                
-                ParserNode* node = [[ParserNodeText alloc] initWithText:text range:NSMakeRange(range.location, rawLength)];
-                [(ParserNode*)[stack lastObject] addChild:node];
-                node.lines = NSMakeRange(lastLine, currentLine - lastLine + 1);
-                lastLine = currentLine;
-                [node release];
                 
                 range.location += rawLength;
                 range.length -= rawLength;
                 rawLength = 0;
             }
+            if(trackLines) {
+                line += _CountLineBreaksInBuffer(textBuffer + lineLocation, range.location - lineLocation);
+                lineLocation = range.location;
+            }
             if([prefixClass isAtomic]) {
                 NSUInteger length = prefixLength;
                 NSUInteger suffixLength = NSNotFound;
-                while(1) {
-                    suffixLength = [prefixClass isMatchingSuffix:(textBuffer + range.location + length) maxLength:(range.length - length)];
-                    if(suffixLength != NSNotFound) {
-                        break;
+                if(prefixTerminator) {
+                    NSUInteger offset = _FindTerminator(prefixTerminator, textBuffer + range.location + length, range.length - length);
+                    if(offset != NSNotFound) {
+                        length += offset;
+                        suffixLength = prefixTerminator->length;
+                    } else {
+                        length = range.length;
                     }
-                    if(length == range.length) {
-                        break;
+                } else {
+                    while(1) {
+                        suffixLength = [prefixClass isMatchingSuffix:(textBuffer + range.location + length) maxLength:(range.length - length)];
+                        if(suffixLength != NSNotFound) {
+                            break;
+                        }
+                        if(length == range.length) {
+                            break;
+                        }
+                        ++length;
                     }
-                    ++length;
                 }
                 if(suffixLength == NSNotFound) {
                     prefixClass = [ParserNodeText class];
@@ -292,38 +953,30 @@
                 }
                 length = length + suffixLength;
                 
-                for(NSUInteger i = 0; i < length; ++i) {
-                    if((*(textBuffer + range.location + i) == '\n') || ((*(textBuffer + range.location + i) == '\r') && (*(textBuffer + range.location + i + 1) != '\n'))) {
-                        ++currentLine;
-                    }
+                if(!_SendEvent(function, context, textBuffer, kParserEventType_Leaf, prefixClass, range.location, length, line)) {
+                    goto Exit;
                 }
                 
-                ParserNode* node = [[prefixClass alloc] initWithText:text range:NSMakeRange(range.location, length)];
-                node.lines = NSMakeRange(lastLine, currentLine - lastLine + 1);
-                lastLine = currentLine;
-                [(ParserNode*)[stack lastObject] addChild:node];
-                [node release];
-                
                 range.location += length;
                 range.length -= length;
             } else {
-                ParserNode* node = [[prefixClass alloc] initWithText:text range:NSMakeRange(range.location, 0)];
-                node.lines = NSMakeRange(currentLine, 0);
-                [(ParserNode*)[stack lastObject] addChild:node];
-                [stack addObject:node];
-                [node release];
-                
-                for(NSUInteger i = 0; i < prefixLength; ++i) {
-                    if((*(textBuffer + range.location + i) == '\n') || ((*(textBuffer + range.location + i) == '\r') && (*(textBuffer + range.location + i + 1) != '\n'))) {
-                        ++currentLine;
-                    }
+                if(depth == capacity) {
+                    capacity *= 2;
+                    stack = realloc(stack, capacity * sizeof(OpenedNode));
                 }
+                stack[depth].nodeClass = prefixClass;
+                stack[depth].location = range.location;
+                stack[depth].line = line;
+                stack[depth].skipSet = prefixSkipSet;
+                ++depth;
+                skipSet = prefixSkipSet;
                 
-                node = [[ParserNodeMatch alloc] initWithText:text range:NSMakeRange(range.location, prefixLength)];
-                node.lines = NSMakeRange(lastLine, currentLine - lastLine + 1);
-                lastLine = currentLine;
-                [(ParserNode*)[stack lastObject] addChild:node];
-                [node release];
+                if(!_SendEvent(function, context, textBuffer, kParserEventType_Open, prefixClass, range.location, 0, line)) {
+                    goto Exit;
+                }
+                if(!_SendEvent(function, context, textBuffer, kParserEventType_Leaf, [ParserNodeMatch class], range.location, prefixLength, line)) {
+                    goto Exit;
+                }
                 
                 range.location += prefixLength;
                 range.length -= prefixLength;
@@ -332,55 +985,131 @@
         }
         
         ++rawLength;
+        if(skipSet->enabled) {
+            rawLength += _SkipCharacters(skipSet, textBuffer + range.location + rawLength, range.length - rawLength);
+        }
         if(rawLength == range.length) {
-            for(NSUInteger i = 0; i < rawLength; ++i) {
-                if((*(textBuffer + range.location + i) == '\n') || ((*(textBuffer + range.location + i) == '\r') && (*(textBuffer + range.location + i + 1) != '\n'))) {
-                    ++currentLine;
-                }
+            if(trackLines) {
+                line += _CountLineBreaksInBuffer(textBuffer + lineLocation, range.location - lineLocation);
+                lineLocation = range.location;
+            }
+            if(!_SendEvent(function, context, textBuffer, kParserEventType_Leaf, [ParserNodeText class], range.location, range.length, line)) {
+                goto Exit;
             }
-            
-            ParserNode* node = [[ParserNodeText alloc] initWithText:text range:range];
-            node.lines = NSMakeRange(lastLine, currentLine - lastLine + 1);
-            [(ParserNode*)[stack lastObject] addChild:node];
-            [node release];
             break;
         }
     }
     
-    [stack removeObjectAtIndex:0];
-    if(stack.count > 0) {
+    if(depth > 0) {
         NSLog(@"Parser failed because some branch nodes are still opened at the end of the text:");
-        for(ParserNode* node in stack) {
-            NSLog(@"\t%@", node);
+        for(NSUInteger i = 0; i < depth; ++i) {
+            NSLog(@"\t%@ at character %lu", [stack[i].nodeClass name], (unsigned long)stack[i].location);
         }
-        [rootNode release];
+    } else {
+        success = YES;
+    }
+    
+Exit:
+    free(stack);
+    return success;
+}
+
+typedef struct {
+    NSString* text;
+    ParserNode** nodes; //Root followed by currently opened nodes
+    NSUInteger depth;
+    NSUInteger capacity;
+} TreeBuilder;
+
+static BOOL _TreeBuilderEventFunction(const ParserEvent* event, void* context) {
+    TreeBuilder* builder = (TreeBuilder*)context;
+    switch(event->type) {
+        
+        case kParserEventType_Open: {
+            ParserNode* node = [[event->nodeClass alloc] initWithText:builder->text range:event->range];
+            [builder->nodes[builder->depth] addChild:node];
+            [node release];
+            if(builder->depth + 1 == builder->capacity) {
+                builder->capacity *= 2;
+                builder->nodes = realloc(builder->nodes, builder->capacity * sizeof(ParserNode*));
+            }
+            builder->nodes[++builder->depth] = node;
+            break;
+        }
+        
+        case kParserEventType_Close: {
+            builder->nodes[builder->depth].range = event->range;
+            --builder->depth;
+            break;
+        }
+        
+        case kParserEventType_Leaf: {
+            ParserNode* node = [[event->nodeClass alloc] initWithText:builder->text range:event->range];
+            [builder->nodes[builder->depth] addChild:node];
+            [node release];
+            break;
+        }
+        
+    }
+    return YES;
+}
+
++ (ParserNodeRoot*) newNodeTreeFromText:(NSString*)text range:(NSRange)range textBuffer:(const unichar*)textBuffer withNodeClasses:(NSArray*)nodeClasses {
+    ParserNodeRoot* rootNode = [[ParserNodeRoot alloc] initWithText:text range:range];
+    if(rootNode == nil) {
         return nil;
     }
     
-    rootNode.lines = NSMakeRange(0, currentLine + 1);
+    TreeBuilder builder;
+    builder.text = text;
+    builder.capacity = 32;
+    builder.nodes = malloc(builder.capacity * sizeof(ParserNode*));
+    builder.nodes[0] = rootNode;
+    builder.depth = 0;
+    BOOL success = _TokenizeText(textBuffer, range, _DispatchTableForNodeClasses(nodeClasses), NO, _TreeBuilderEventFunction, &builder);
+    free(builder.nodes);
+    if(!success) {
+        [rootNode release];
+        return nil;
+    }
     
     return rootNode;
 }
 
-static ParserNodeRoot* _NewNodeTreeFromText(id self, NSString* text, NSArray* nodeClasses, BOOL syntaxAnalysis) {
+//"textBuffer" must contain the characters of "text" with one-character zero padding on each side
+static ParserNodeRoot* _NewNodeTreeFromBuffer(id self, NSString* text, const unichar* textBuffer, NSArray* nodeClasses, BOOL syntaxAnalysis) {
+    ParserArena* arena = _arenaAllocation ? _ParserArenaCreate(text) : NULL;
+    ParserArena* previousArena = _ParserArenaSetCurrent(arena);
     NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
-    text = [text copy];
     NSRange range = NSMakeRange(0, text.length);
-    unichar* buffer = malloc((range.length + 2) * sizeof(unichar));
-    buffer[0] = 0x0000; //We need one-character padding at the start since some nodes look at buffer[index - 1]
-    buffer[range.length + 1] = 0x0000; //We need one-character padding at the end since some nodes look at buffer[index + 1]
-    [text getCharacters:(buffer + 1)];
-    
     ParserNodeRoot* root;
     if([self isKindOfClass:[ParserLanguage class]]) {
-        root = [[self parseText:text range:range textBuffer:(buffer + 1) syntaxAnalysis:syntaxAnalysis] retain];
+        root = [[self parseText:text range:range textBuffer:textBuffer syntaxAnalysis:syntaxAnalysis] retain];
     } else {
-        root = [self newNodeTreeFromText:text range:range textBuffer:(buffer + 1) withNodeClasses:nodeClasses];
+        root = [self newNodeTreeFromText:text range:range textBuffer:textBuffer withNodeClasses:nodeClasses];
+    }
+    [root buildLineIndexWithTextBuffer:textBuffer]; //Scanning the buffer now avoids copying the characters again later
+    [pool drain];
+    _ParserArenaSetCurrent(previousArena);
+    if(arena) {
+        _ParserArenaRelease(arena); //The nodes of the tree now hold the only references to the arena
     }
     
+    return root;
+}
+
+static ParserNodeRoot* _NewNodeTreeFromText(id self, NSString* text, NSArray* nodeClasses, BOOL syntaxAnalysis) {
+    text = [text copy];
+    NSUInteger length = text.length;
+    unichar* buffer = malloc((length + 2) * sizeof(unichar));
+    buffer[0] = 0x0000; //We need one-character padding at the start since some nodes look at buffer[index - 1]
+    buffer[length + 1] = 0x0000; //We need one-character padding at the end since some nodes look at buffer[index + 1]
+    [text getCharacters:(buffer + 1)];
+    
+    ParserNodeRoot* root = _NewNodeTreeFromBuffer(self, text, buffer + 1, nodeClasses, syntaxAnalysis);
+    
     free(buffer);
     [text release];
-    [pool drain];
     
     return root;
 }
@@ -389,7 +1118,6 @@ static ParserNodeRoot* _NewNodeTreeFromText(id self, NSString* text, NSArray* no
     return _NewNodeTreeFromText(self, text, nodeClasses, NO);
 }
 
-//FIXME: Also check lines
 static BOOL _CheckTreeConsistency(ParserNode* node, NSMutableArray* stack) {
     NSRange range = node.range;
     for(ParserNode* subnode in node.children) {
@@ -425,12 +1153,79 @@ static ParserNode* _SyntaxAnalysisApplierFunction(ParserNode* node, void* contex
     return [language performSyntaxAnalysis:passIndex forNode:node textBuffer:buffer topLevelLanguage:topLevelLanguage];
 }
 
+/* Rules are resolved once per language into a table of functions per pass indexed by node kind, so nodes without a rule are skipped with a single lookup */
+static const ParserSyntaxAnalysisFunction* _SyntaxAnalysisFunctions(ParserLanguage* language, const ParserSyntaxAnalysisRule* rules, NSUInteger passIndex) {
+    if(language->_syntaxAnalysisFunctions == NULL) {
+        NSUInteger passes = [[language class] languageSyntaxAnalysisPasses];
+        ParserSyntaxAnalysisFunction* functions = calloc(passes * _kindCount, sizeof(ParserSyntaxAnalysisFunction));
+        for(const ParserSyntaxAnalysisRule* rule = rules; rule->nodeClass; ++rule) {
+            NSUInteger kind = _KindOfClass(objc_getClass(rule->nodeClass));
+            if((kind == NSNotFound) || (rule->passIndex >= passes)) {
+                free(functions);
+                [NSException raise:NSInternalInconsistencyException format:@"Invalid syntax analysis rule for \"%s\" in %@", rule->nodeClass, [language class]];
+            }
+            for(NSUInteger i = 0; i < _kindCount; ++i) {
+                ParserSyntaxAnalysisFunction* function = &functions[rule->passIndex * _kindCount + i];
+                if((*function == NULL) && _IsKindInMask(kind, &_kindMasks[i * _kindMaskWords])) {
+                    *function = rule->function;
+                }
+            }
+        }
+        if(!__sync_bool_compare_and_swap(&language->_syntaxAnalysisFunctions, NULL, functions)) { //Languages can be used on multiple threads
+            free(functions);
+        }
+    }
+    return &((ParserSyntaxAnalysisFunction*)language->_syntaxAnalysisFunctions)[passIndex * _kindCount];
+}
+
+/* Only the recorded nodes with a function are visited instead of all nodes, in the depth-first order of a tree walk and skipping the nodes it would not reach */
+static void _ApplySyntaxAnalysisFunctions(ParserLanguage* language, const ParserSyntaxAnalysisFunction* functions, ParserNodeRecorder* recorder, ParserNodeRoot* rootNode, const unichar* textBuffer, ParserLanguage* topLevelLanguage) {
+    NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+    NSUInteger count;
+    ParserNode** nodes = _CopyRecordedNodesInTree(recorder, functions, rootNode, &count);
+    CFMutableSetRef skippedNodes = NULL; //Nodes whose children must not be processed
+    for(NSUInteger i = 0; i < count; ++i) {
+        ParserSyntaxAnalysisFunction function = functions[nodes[i]->_kind]; //Nodes may have been retyped since
+        if((function == NULL) || (_DepthInTree(nodes[i], rootNode, skippedNodes) == NSNotFound)) {
+            continue;
+        }
+        if((*function)(language, nodes[i], textBuffer, topLevelLanguage) == nil) {
+            if(skippedNodes == NULL) {
+                skippedNodes = CFSetCreateMutable(kCFAllocatorDefault, 0, NULL);
+            }
+            CFSetAddValue(skippedNodes, nodes[i]);
+        }
+    }
+    if(skippedNodes) {
+        CFRelease(skippedNodes);
+    }
+    free(nodes);
+    [pool drain];
+}
+
 - (ParserNodeRoot*) parseText:(NSString*)text range:(NSRange)range textBuffer:(const unichar*)textBuffer syntaxAnalysis:(BOOL)syntaxAnalysis {
+    ParserNodeRecorder* recorder = NULL;
+    if(syntaxAnalysis) {
+        for(ParserLanguage* language in self.allLanguageDependencies) {
+            if([[language class] languageSyntaxAnalysisRules]) {
+                recorder = _ParserNodeRecorderCreate();
+                break;
+            }
+        }
+    }
+    ParserNodeRecorder* previousRecorder = _ParserNodeRecorderSetCurrent(recorder);
     ParserNodeRoot* rootNode = [[[self class] newNodeTreeFromText:text range:range textBuffer:textBuffer withNodeClasses:self.nodeClasses] autorelease];
     if(rootNode == nil) {
+        _ParserNodeRecorderSetCurrent(previousRecorder);
+        if(recorder) {
+            _ParserNodeRecorderRelease(recorder);
+        }
         return nil;
     }
     rootNode.language = self;
+    if(recorder) {
+        _ParserNodeRecorderEndOrderedNodes(recorder);
+    }
     
     if(syntaxAnalysis) {
         NSUInteger passIndex = 0;
@@ -446,25 +1241,35 @@ static ParserNode* _SyntaxAnalysisApplierFunction(ParserNode* node, void* contex
                 break;
             }
             for(ParserLanguage* language in languages) {
-                ParserNode* node = [language performSyntaxAnalysis:passIndex forNode:rootNode textBuffer:textBuffer topLevelLanguage:self];
-                if(node) {
-                    void* params[4];
-                    params[0] = language;
-                    params[1] = (void*)passIndex;
-                    params[2] = (void*)textBuffer;
-                    params[3] = self;
-                    [node applyFunctionOnChildren:_SyntaxAnalysisApplierFunction context:params];
+                const ParserSyntaxAnalysisRule* rules = [[language class] languageSyntaxAnalysisRules];
+                if(rules) {
+                    _ApplySyntaxAnalysisFunctions(language, _SyntaxAnalysisFunctions(language, rules, passIndex), recorder, rootNode, textBuffer, self);
+                } else {
+                    ParserNode* node = [language performSyntaxAnalysis:passIndex forNode:rootNode textBuffer:textBuffer topLevelLanguage:self];
+                    if(node) {
+                        void* params[4];
+                        params[0] = language;
+                        params[1] = (void*)passIndex;
+                        params[2] = (void*)textBuffer;
+                        params[3] = self;
+                        [node applyFunctionOnChildren:_SyntaxAnalysisApplierFunction context:params];
+                    }
                 }
             }
             ++passIndex;
         }
     }
+    _ParserNodeRecorderSetCurrent(previousRecorder);
+    if(recorder) {
+        _ParserNodeRecorderRelease(recorder);
+    }
     
     NSMutableArray* stack = [NSMutableArray array];
     if(!_CheckTreeConsistency(rootNode, stack)) {
         NSLog(@"Parser failed because resulting tree is not consistent:\n%@\n%@", [[(ParserNode*)[stack objectAtIndex:0] parent] detailedDescription], stack);
         return nil;
     }
+    _MarkNodeUnmodified(rootNode, text);
     
     return rootNode;
 }
@@ -473,6 +1278,69 @@ static ParserNode* _SyntaxAnalysisApplierFunction(ParserNode* node, void* contex
     return [_NewNodeTreeFromText(self, text, nil, syntaxAnalysis) autorelease];
 }
 
+- (BOOL) parseText:(NSString*)text withEventFunction:(ParserEventFunction)function context:(void*)context {
+    NSUInteger length = text.length;
+    unichar* buffer = malloc((length + 2) * sizeof(unichar));
+    buffer[0] = 0x0000;
+    buffer[length + 1] = 0x0000;
+    [text getCharacters:(buffer + 1)];
+    
+    BOOL success = _TokenizeText(buffer + 1, NSMakeRange(0, length), _DispatchTableForNodeClasses(self.nodeClasses), YES, function, context);
+    
+    free(buffer);
+    
+    return success;
+}
+
++ (BOOL) parseTextFile:(NSString*)path language:(ParserLanguage*)language encoding:(NSStringEncoding)encoding withEventFunction:(ParserEventFunction)function context:(void*)context {
+    if(language == nil) {
+        language = _DefaultLanguageForPath(path);
+        if(language == nil) {
+            return NO;
+        }
+    }
+    NSData* data = _NewDataWithContentsOfInput(path);
+    if(data == nil) {
+        return NO;
+    }
+    BOOL success;
+    if(encoding == NSUTF8StringEncoding) {
+        const unichar* buffer;
+        NSString* string = _NewStringWithPaddedBufferFromUTF8(data.bytes, data.length, &buffer); //Tokenizes straight from the decoded characters
+        [data release];
+        if(string == nil) {
+            return NO;
+        }
+        if(buffer) {
+            success = _TokenizeText(buffer, NSMakeRange(0, string.length), _DispatchTableForNodeClasses(language.nodeClasses), YES, function, context);
+        } else {
+            success = [language parseText:string withEventFunction:function context:context];
+        }
+        [string release];
+    } else {
+        NSString* string = [[NSString alloc] initWithData:data encoding:encoding];
+        [data release];
+        if(string == nil) {
+            return NO;
+        }
+        success = [language parseText:string withEventFunction:function context:context];
+        [string release];
+    }
+    return success;
+}
+
+#if NS_BLOCKS_AVAILABLE
+
+static BOOL _BlockEventFunction(const ParserEvent* event, void* context) {
+    return ((BOOL (^)(const ParserEvent* event))context)(event);
+}
+
+- (BOOL) parseText:(NSString*)text usingEventBlock:(BOOL (^)(const ParserEvent* event))block {
+    return [self parseText:text withEventFunction:_BlockEventFunction context:block];
+}
+
+#endif
+
 - (ParserNode*) performSyntaxAnalysis:(NSUInteger)passIndex forNode:(ParserNode*)node textBuffer:(const unichar*)textBuffer topLevelLanguage:(ParserLanguage*)topLevelLanguage {
     return nil;
 }
@@ -487,6 +1355,14 @@ static ParserNode* _SyntaxAnalysisApplierFunction(ParserNode* node, void* contex
     return NO;
 }
 
+- (void) dealloc {
+    if(_lineIndex) {
+        free(_lineIndex);
+    }
+    
+    [super dealloc];
+}
+
 - (id) copyWithZone:(NSZone*)zone {
     ParserNodeRoot* copy = [super copyWithZone:zone];
     if(copy) {
@@ -495,10 +1371,412 @@ static ParserNode* _SyntaxAnalysisApplierFunction(ParserNode* node, void* contex
     return copy;
 }
 
+typedef struct {
+    NSUInteger count;
+    NSUInteger capacity;
+    NSUInteger locations[];
+} LineIndex;
+
+static LineIndex* _NewLineIndex() {
+    LineIndex* index = malloc(sizeof(LineIndex) + 256 * sizeof(NSUInteger));
+    index->count = 0;
+    index->capacity = 256;
+    return index;
+}
+
+//Line breaks are "\n" or "\r" not followed by "\n" - "buffer" must be readable at "length"
+static LineIndex* _AddLineBreaksInBuffer(LineIndex* index, const unichar* buffer, NSUInteger length, NSUInteger offset) {
+    NSUInteger location = 0;
+    while(1) {
+        location += _SkipCharacters(&_newlineSkipSet, buffer + location, length - location);
+        if(location == length) {
+            break;
+        }
+        if((buffer[location] == '\n') || (buffer[location + 1] != '\n')) {
+            if(index->count == index->capacity) {
+                index->capacity *= 2;
+                index = realloc(index, sizeof(LineIndex) + index->capacity * sizeof(NSUInteger));
+            }
+            index->locations[index->count++] = offset + location;
+        }
+        ++location;
+    }
+    return index;
+}
+
+//Trees may be shared across threads so the first index published wins
+static LineIndex* _PublishLineIndex(ParserNodeRoot* root, LineIndex* index) {
+    if(!__sync_bool_compare_and_swap(&root->_lineIndex, NULL, index)) {
+        free(index);
+    }
+    return root->_lineIndex;
+}
+
+- (void) buildLineIndexWithTextBuffer:(const unichar*)textBuffer {
+    NSRange range = self.range;
+    _PublishLineIndex(self, _AddLineBreaksInBuffer(_NewLineIndex(), textBuffer + range.location, range.length, range.location));
+}
+
+//The index is built while parsing so this only scans the text again after the tree was reparsed or if it was not parsed from a buffer
+static LineIndex* _GetLineIndex(ParserNodeRoot* root) {
+    LineIndex* index = root->_lineIndex;
+    if(index == NULL) {
+        NSRange range = root.range;
+        NSString* text = root.text;
+        unichar buffer[kLineIndexChunkSize + 1];
+        index = _NewLineIndex();
+        for(NSUInteger offset = 0; offset < range.length; offset += kLineIndexChunkSize) {
+            NSUInteger length = MIN(range.length - offset, kLineIndexChunkSize);
+            if(offset + length < range.length) {
+                [text getCharacters:buffer range:NSMakeRange(range.location + offset, length + 1)]; //Also get the first character of the next chunk
+            } else {
+                [text getCharacters:buffer range:NSMakeRange(range.location + offset, length)];
+                buffer[length] = 0x0000;
+            }
+            index = _AddLineBreaksInBuffer(index, buffer, length, range.location + offset);
+        }
+        index = _PublishLineIndex(root, index);
+    }
+    return index;
+}
+
+//Returns the number of line breaks before "location"
+static NSUInteger _CountLineBreaks(const LineIndex* index, NSUInteger location) {
+    NSUInteger start = 0;
+    NSUInteger end = index->count;
+    while(start < end) {
+        NSUInteger middle = (start + end) / 2;
+        if(index->locations[middle] < location) {
+            start = middle + 1;
+        } else {
+            end = middle;
+        }
+    }
+    return start;
+}
+
+- (NSRange) linesForRange:(NSRange)range {
+    LineIndex* index = _GetLineIndex(self);
+    NSUInteger start = _CountLineBreaks(index, range.location);
+    NSUInteger end = _CountLineBreaks(index, range.location + range.length);
+    return NSMakeRange(start, end - start + 1);
+}
+
+- (BOOL) getLine:(NSUInteger*)line column:(NSUInteger*)column forLocation:(NSUInteger)location {
+    NSRange range = self.range;
+    if((location < range.location) || (location > range.location + range.length)) {
+        return NO;
+    }
+    LineIndex* index = _GetLineIndex(self);
+    NSUInteger count = _CountLineBreaks(index, location);
+    if(line) {
+        *line = count;
+    }
+    if(column) {
+        *column = location - (count ? index->locations[count - 1] + 1 : range.location);
+    }
+    return YES;
+}
+
 - (BOOL) writeContentToFile:(NSString*)path encoding:(NSStringEncoding)encoding {
     return [[self content] writeToFile:path atomically:YES encoding:encoding error:NULL];
 }
 
+static BOOL _IsReparseBoundary(ParserLanguage* language, ParserNode* node) {
+    if(!node.children || ![[node class] isReparseBoundary]) {
+        return NO;
+    }
+    for(ParserLanguage* dependency in language.allLanguageDependencies) {
+        if(![[dependency class] languageAllowsReparseBoundary:[node class]]) {
+            return NO;
+        }
+    }
+    return YES;
+}
+
+//Returns boundaries strictly containing "range" deepest first - The tree must not be modified
+static NSArray* _FindReparseBoundaries(ParserLanguage* language, ParserNode* node, NSRange range) {
+    NSMutableArray* boundaries = [NSMutableArray array];
+    while(1) {
+        NSArray* children = node.children;
+        NSUInteger start = 0;
+        NSUInteger end = children.count;
+        while(start < end) {
+            NSUInteger middle = (start + end) / 2;
+            NSRange childRange = [(ParserNode*)[children objectAtIndex:middle] range];
+            if(childRange.location + childRange.length <= range.location) {
+                start = middle + 1;
+            } else {
+                end = middle;
+            }
+        }
+        if(start == children.count) {
+            break;
+        }
+        node = [children objectAtIndex:start];
+        NSRange nodeRange = node.range;
+        if((nodeRange.location >= range.location) || (nodeRange.location + nodeRange.length <= range.location + range.length)) {
+            break;
+        }
+        if(_IsReparseBoundary(language, node)) {
+            [boundaries insertObject:node atIndex:0];
+        }
+    }
+    return boundaries;
+}
+
+- (BOOL) _reparseText:(NSString*)text {
+    ParserNodeRoot* root = [_language parseText:text syntaxAnalysis:YES];
+    if(root == nil) {
+        return NO;
+    }
+    
+    _MoveChildren(self, NSMakeRange(0, self.children.count), nil, 0);
+    _ShiftNodeTree(self, root.text, NSMakeRange(0, 0), 0, nil);
+    self.range = root.range;
+    _MoveChildren(root, NSMakeRange(0, root.children.count), self, 0);
+    _MarkNodeUnmodified(self, root.text);
+    return YES;
+}
+
+- (BOOL) reparseWithEditedRange:(NSRange)range replacementText:(NSString*)text {
+    NSRange rootRange = self.range;
+    if((_language == nil) || (range.location < rootRange.location) || (range.location + range.length > rootRange.location + rootRange.length)) {
+        return NO;
+    }
+    if(text == nil) {
+        text = @"";
+    }
+    
+    BOOL success = NO;
+    NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+    if(self.modified || (rootRange.location != 0) || (rootRange.length != self.text.length)) { //The text no longer matches the tree
+        success = [self _reparseText:[self.content stringByReplacingCharactersInRange:range withString:text]];
+    } else {
+        NSString* newText = [[[self.text stringByReplacingCharactersInRange:range withString:text] copy] autorelease];
+        NSInteger delta = (NSInteger)text.length - (NSInteger)range.length;
+        for(ParserNode* node in _FindReparseBoundaries(_language, self, range)) {
+            NSRange newRange = NSMakeRange(node.range.location, node.range.length + delta);
+            NSString* nodeText = [newText substringWithRange:newRange];
+            
+            //Surround the characters of the node with the actual characters around it instead of zero padding
+            unichar* buffer = malloc((newRange.length + 2) * sizeof(unichar));
+            buffer[0] = newRange.location > 0 ? [newText characterAtIndex:(newRange.location - 1)] : 0x0000;
+            buffer[newRange.length + 1] = newRange.location + newRange.length < newText.length ? [newText characterAtIndex:(newRange.location + newRange.length)] : 0x0000;
+            [newText getCharacters:(buffer + 1) range:newRange];
+            ParserNodeRoot* root = [_language parseText:nodeText range:NSMakeRange(0, newRange.length) textBuffer:(buffer + 1) syntaxAnalysis:YES];
+            free(buffer);
+            
+            if((root.children.count == 1) && ([root.firstChild class] == [node class]) && NSEqualRanges(root.firstChild.range, NSMakeRange(0, newRange.length))) {
+                ParserNode* newNode = [root.firstChild retain];
+                [root removeChildAtIndex:0];
+                _ShiftNodeTree(newNode, newText, NSMakeRange(0, 0), newRange.location, nil); //Move the reparsed nodes from the characters of the node to their location in the new text
+                _ShiftNodeTree(self, newText, range, delta, node);
+                [node replaceWithNode:newNode];
+                [newNode release];
+                _MarkNodeUnmodified(self, newText);
+                success = YES;
+                break;
+            }
+        }
+        if(!success) {
+            success = [self _reparseText:newText];
+        }
+    }
+    [pool drain];
+    
+    if(success && _lineIndex) {
+        free(_lineIndex);
+        _lineIndex = NULL;
+    }
+    return success;
+}
+
+- (ParserFrozenTree*) freeze {
+    return [[[ParserFrozenTree alloc] _initWithRoot:self] autorelease];
+}
+
+@end
+
+#define kFrozenNone UINT32_MAX
+
+typedef struct {
+    NSString* text; //Text shared by all leaves as long as "content" is nil
+    NSUInteger base;
+    NSMutableString* content;
+    NSUInteger location;
+    CFMutableDictionaryRef kinds;
+} Freezer;
+
+@implementation ParserFrozenTree
+
+@synthesize text=_text, language=_language, count=_count;
+
+static NSUInteger _CountNodes(ParserNode* node) {
+    NSUInteger count = 1;
+    for(ParserNode* child in node.children) {
+        count += _CountNodes(child);
+    }
+    return count;
+}
+
+//Ranges are recomputed from the leaves so that they always match the content of the frozen tree, even after edits
+static uint32_t _FreezeNode(ParserFrozenTree* tree, Freezer* freezer, ParserNode* node, uint32_t parent, uint32_t* nextIndex) {
+    uint32_t index = (*nextIndex)++;
+    Class class = [node class];
+    uint32_t kind;
+    const void* value;
+    if(CFDictionaryGetValueIfPresent(freezer->kinds, class, &value)) {
+        kind = (uint32_t)(uintptr_t)value;
+    } else {
+        kind = CFDictionaryGetCount(freezer->kinds);
+        CFDictionarySetValue(freezer->kinds, class, (const void*)(uintptr_t)kind);
+        tree->_classes[kind] = class;
+    }
+    tree->_kinds[index] = kind;
+    tree->_starts[index] = freezer->location;
+    tree->_parents[index] = parent;
+    tree->_firstChildren[index] = kFrozenNone;
+    tree->_nextSiblings[index] = kFrozenNone;
+    
+    NSArray* children = node.children;
+    if(children) {
+        uint32_t previous = kFrozenNone;
+        for(ParserNode* child in children) {
+            uint32_t childIndex = _FreezeNode(tree, freezer, child, index, nextIndex);
+            if(previous == kFrozenNone) {
+                tree->_firstChildren[index] = childIndex;
+            } else {
+                tree->_nextSiblings[previous] = childIndex;
+            }
+            previous = childIndex;
+        }
+    } else {
+        NSRange range = node.range;
+        if((freezer->content == nil) && ((node.text != freezer->text) || (range.location != freezer->base + freezer->location))) {
+            freezer->content = [[NSMutableString alloc] initWithString:[freezer->text substringWithRange:NSMakeRange(freezer->base, freezer->location)]];
+        }
+        if(freezer->content) {
+            NSString* content = node.content;
+            [freezer->content appendString:content];
+            range.length = content.length;
+        }
+        freezer->location += range.length;
+    }
+    tree->_lengths[index] = freezer->location - tree->_starts[index];
+    
+    return index;
+}
+
+- (id) _initWithRoot:(ParserNodeRoot*)root {
+    if((self = [super init])) {
+        _count = _CountNodes(root);
+        if((_count >= kFrozenNone) || (root.range.length >= kFrozenNone)) {
+            NSLog(@"%@ cannot freeze tree of %i nodes", [self class], (int)_count);
+            [self release];
+            return nil;
+        }
+        _language = root.language;
+        
+        _classes = malloc(_count * sizeof(Class));
+        _kinds = malloc(_count * sizeof(uint32_t));
+        _starts = malloc(_count * sizeof(uint32_t));
+        _lengths = malloc(_count * sizeof(uint32_t));
+        _parents = malloc(_count * sizeof(uint32_t));
+        _firstChildren = malloc(_count * sizeof(uint32_t));
+        _nextSiblings = malloc(_count * sizeof(uint32_t));
+        
+        Freezer freezer;
+        freezer.text = root.text;
+        freezer.base = root.range.location;
+        freezer.content = nil;
+        freezer.location = 0;
+        freezer.kinds = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, NULL);
+        uint32_t nextIndex = 0;
+        _FreezeNode(self, &freezer, root, kFrozenNone, &nextIndex);
+        _classes = realloc(_classes, CFDictionaryGetCount(freezer.kinds) * sizeof(Class));
+        CFRelease(freezer.kinds);
+        
+        if(freezer.content) {
+            _text = [freezer.content copy];
+            [freezer.content release];
+        } else if((freezer.base == 0) && (freezer.location == freezer.text.length)) {
+            _text = [freezer.text copy];
+        } else {
+            _text = [[freezer.text substringWithRange:NSMakeRange(freezer.base, freezer.location)] retain];
+        }
+    }
+    
+    return self;
+}
+
+- (void) dealloc {
+    free(_classes);
+    free(_kinds);
+    free(_starts);
+    free(_lengths);
+    free(_parents);
+    free(_firstChildren);
+    free(_nextSiblings);
+    [_text release];
+    
+    [super dealloc];
+}
+
+static inline void _CheckIndex(ParserFrozenTree* tree, NSUInteger index) {
+    if(index >= tree->_count) {
+        [NSException raise:NSRangeException format:@"Index %i is out of bounds", (int)index];
+    }
+}
+
+- (Class) nodeClassAtIndex:(NSUInteger)index {
+    _CheckIndex(self, index);
+    return _classes[_kinds[index]];
+}
+
+- (NSRange) rangeAtIndex:(NSUInteger)index {
+    _CheckIndex(self, index);
+    return NSMakeRange(_starts[index], _lengths[index]);
+}
+
+- (NSString*) contentAtIndex:(NSUInteger)index {
+    return [_text substringWithRange:[self rangeAtIndex:index]];
+}
+
+- (NSUInteger) parentAtIndex:(NSUInteger)index {
+    _CheckIndex(self, index);
+    return _parents[index] != kFrozenNone ? _parents[index] : NSNotFound;
+}
+
+- (NSUInteger) firstChildAtIndex:(NSUInteger)index {
+    _CheckIndex(self, index);
+    return _firstChildren[index] != kFrozenNone ? _firstChildren[index] : NSNotFound;
+}
+
+- (NSUInteger) nextSiblingAtIndex:(NSUInteger)index {
+    _CheckIndex(self, index);
+    return _nextSiblings[index] != kFrozenNone ? _nextSiblings[index] : NSNotFound;
+}
+
+static ParserNode* _NewNodeFromFrozenTree(ParserFrozenTree* tree, uint32_t index) {
+    ParserNode* node = [[tree->_classes[tree->_kinds[index]] alloc] initWithText:tree->_text range:NSMakeRange(tree->_starts[index], tree->_lengths[index])];
+    for(uint32_t child = tree->_firstChildren[index]; child != kFrozenNone; child = tree->_nextSiblings[child]) {
+        ParserNode* childNode = _NewNodeFromFrozenTree(tree, child);
+        [node addChild:childNode];
+        [childNode release];
+    }
+    return node;
+}
+
+- (ParserNode*) nodeAtIndex:(NSUInteger)index {
+    _CheckIndex(self, index);
+    ParserNode* node = _NewNodeFromFrozenTree(self, index);
+    if(index == 0) {
+        [(ParserNodeRoot*)node setLanguage:_language];
+    }
+    return [node autorelease];
+}
+
 @end
 
 @implementation ParserNodeText
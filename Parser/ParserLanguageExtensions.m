@@ -29,23 +29,16 @@ void _RearrangeNodesAsParentAndChildren(ParserNode* startNode, ParserNode* endNo
         [NSException raise:NSInternalInconsistencyException format:@""];
     }
     
-    ParserNode* node;
+    ParserNode* parent = startNode.parent;
+    NSUInteger start = [parent indexOfChild:startNode] + 1;
+    NSUInteger end = [parent indexOfChild:endNode];
     if(startNode.range.length) {
-        node = [[ParserNodeMatch alloc] initWithText:startNode.text range:startNode.range];
-        node.lines = startNode.lines;
+        ParserNode* node = [[ParserNodeMatch alloc] initWithText:startNode.text range:startNode.range];
         [startNode addChild:node];
         [node release];
     }
-    ParserNode* sibling = startNode.nextSibling;
-    node = sibling;
-    do {
-        ParserNode* sibling = node.nextSibling; //This will not be available afterwards
-        [node removeFromParent];
-        [startNode addChild:node];
-        node = (node == endNode ? nil : sibling);
-    } while(node);
+    _MoveChildren(parent, NSMakeRange(start, end + 1 - start), startNode, startNode.children.count);
     startNode.range = NSMakeRange(startNode.range.location, endNode.range.location + endNode.range.length - startNode.range.location);
-    startNode.lines = NSMakeRange(sibling.lines.location, endNode.lines.location + endNode.lines.length - sibling.lines.location);
 }
 
 void _AdoptNodesAsChildren(ParserNode* startNode, ParserNode* endNode) {
@@ -53,16 +46,10 @@ void _AdoptNodesAsChildren(ParserNode* startNode, ParserNode* endNode) {
         [NSException raise:NSInternalInconsistencyException format:@""];
     }
     
-    ParserNode* sibling = endNode.previousSibling;
-    ParserNode* node = sibling;
-    do {
-        ParserNode* sibling = node.previousSibling; //This will not be available afterwards
-        [node removeFromParent];
-        [endNode insertChild:node atIndex:0];
-        node = (node == startNode ? nil : sibling);
-    } while(node);
+    ParserNode* parent = endNode.parent;
+    NSUInteger start = [parent indexOfChild:startNode];
+    _MoveChildren(parent, NSMakeRange(start, [parent indexOfChild:endNode] - start), endNode, 0);
     endNode.range = NSMakeRange(startNode.range.location, endNode.range.location + endNode.range.length - startNode.range.location);
-    endNode.lines = NSMakeRange(sibling.lines.location, endNode.lines.location + endNode.lines.length - sibling.lines.location);
 }
 
 NSString* _CleanString(NSString* string, NSArray* nodeClasses) {
@@ -71,7 +58,7 @@ NSString* _CleanString(NSString* string, NSArray* nodeClasses) {
         ParserNode* node = root.firstChild;
         do {
             ParserNode* nextNode = node.nextSibling;
-            if([node isKindOfClass:[ParserNodeNewline class]]) {
+            if(IS_KIND(node, Newline)) {
                 [node removeFromParent];
             }
             node = nextNode;
@@ -116,12 +103,97 @@ NSString* _StringFromHexUnicodeCharacter(NSString* string) {
     return [NSString stringWithCharacters:&character length:1];
 }
 
+#define kMaxEntityLength 10
+
+//Returns the number of characters written to "characters" for the numeric entity "name" (without the leading '#') or 0 if it is not valid
+static NSUInteger _DecodeNumericEntity(const unichar* name, NSUInteger length, unichar* characters) {
+    UInt32 base = 10;
+    if(length && ((*name == 'x') || (*name == 'X'))) {
+        base = 16;
+        ++name;
+        --length;
+    }
+    if(length == 0) {
+        return 0;
+    }
+    UInt32 code = 0;
+    for(NSUInteger i = 0; i < length; ++i) {
+        UInt32 digit;
+        if((name[i] >= '0') && (name[i] <= '9')) {
+            digit = name[i] - '0';
+        } else if((base == 16) && (name[i] >= 'a') && (name[i] <= 'f')) {
+            digit = name[i] - 'a' + 10;
+        } else if((base == 16) && (name[i] >= 'A') && (name[i] <= 'F')) {
+            digit = name[i] - 'A' + 10;
+        } else {
+            return 0;
+        }
+        code = code * base + digit;
+        if(code > 0x10FFFF) {
+            return 0;
+        }
+    }
+    if((code == 0) || ((code >= 0xD800) && (code <= 0xDFFF))) {
+        return 0;
+    }
+    if(code > 0xFFFF) {
+        code -= 0x10000;
+        characters[0] = 0xD800 + (code >> 10);
+        characters[1] = 0xDC00 + (code & 0x3FF);
+        return 2;
+    }
+    characters[0] = code;
+    return 1;
+}
+
+/* Entities are decoded in place in a single pass since they are never shorter than the characters they stand for */
+NSString* _StringWithReplacedEntities(NSString* string, ParserEntityLookupFunction lookup) {
+    NSUInteger start = [string rangeOfString:@"&" options:NSLiteralSearch].location;
+    if(start == NSNotFound) {
+        return string;
+    }
+    
+    NSUInteger length = string.length;
+    unichar* buffer = malloc(length * sizeof(unichar));
+    [string getCharacters:buffer];
+    NSUInteger destination = start;
+    NSUInteger source = start;
+    while(source < length) {
+        if(buffer[source] == '&') {
+            NSUInteger end = source + 1;
+            while((end < length) && (end - source <= kMaxEntityLength) && (buffer[end] != ';')) {
+                ++end;
+            }
+            if((end < length) && (buffer[end] == ';')) {
+                const unichar* name = &buffer[source + 1];
+                NSUInteger nameLength = end - source - 1;
+                unichar characters[2];
+                NSUInteger count = 0;
+                if(nameLength && (*name == '#')) {
+                    count = _DecodeNumericEntity(name + 1, nameLength - 1, characters);
+                } else if(nameLength && (characters[0] = (*lookup)(name, nameLength))) {
+                    count = 1;
+                }
+                if(count) {
+                    for(NSUInteger i = 0; i < count; ++i) {
+                        buffer[destination++] = characters[i];
+                    }
+                    source = end + 1;
+                    continue;
+                }
+            }
+        }
+        buffer[destination++] = buffer[source++];
+    }
+    return [[[NSString alloc] initWithCharactersNoCopy:buffer length:destination freeWhenDone:YES] autorelease];
+}
+
 @implementation ParserNode (ParserLanguageExtensions)
 
 - (ParserNode*) findPreviousSiblingIgnoringWhitespaceAndNewline {
     ParserNode* node = self.previousSibling;
     while(node) {
-        if(![node isKindOfClass:[ParserNodeWhitespace class]] && ![node isKindOfClass:[ParserNodeNewline class]]) {
+        if(!IS_KIND(node, Whitespace) && !IS_KIND(node, Newline)) {
             return node;
         }
         node = node.previousSibling;
@@ -132,7 +204,7 @@ NSString* _StringFromHexUnicodeCharacter(NSString* string) {
 - (ParserNode*) findNextSiblingIgnoringWhitespaceAndNewline {
     ParserNode* node = self.nextSibling;
     while(node) {
-        if(![node isKindOfClass:[ParserNodeWhitespace class]] && ![node isKindOfClass:[ParserNodeNewline class]]) {
+        if(!IS_KIND(node, Whitespace) && !IS_KIND(node, Newline)) {
             return node;
         }
         node = node.nextSibling;
@@ -144,6 +216,10 @@ NSString* _StringFromHexUnicodeCharacter(NSString* string) {
 
 @implementation ParserNodeWhitespace
 
++ (NSString*) prefixCharacters {
+    return @" \t";
+}
+
 + (NSUInteger) isMatchingPrefix:(const unichar*)string maxLength:(NSUInteger)maxLength {
     return IsWhitespace(*string) ? 1 : NSNotFound;
 }
@@ -164,6 +240,10 @@ NSString* _StringFromHexUnicodeCharacter(NSString* string) {
     return [NSSet setWithObject:[ParserNodeWhitespace class]];
 }
 
++ (NSString*) prefixCharacters {
+    return @" \t";
+}
+
 + (NSUInteger) isMatchingPrefix:(const unichar*)string maxLength:(NSUInteger)maxLength {
     return IsWhitespace(*string) && ((*(string - 1) == 0) || IsNewline(*(string - 1))) ? 1 : NSNotFound; //The string buffer starts with a padding zero (see ParserLanguage.m)
 }
@@ -180,6 +260,10 @@ NSString* _StringFromHexUnicodeCharacter(NSString* string) {
 
 @implementation ParserNodeNewline
 
++ (NSString*) prefixCharacters {
+    return @"\r\n";
+}
+
 + (NSUInteger) isMatchingPrefix:(const unichar*)string maxLength:(NSUInteger)maxLength {
     return (*string == '\r') && (*(string + 1) == '\n') ? 2 : ((*string == '\r') || (*string == '\n') ? 1 : NSNotFound);
 }
@@ -190,13 +274,25 @@ NSString* _StringFromHexUnicodeCharacter(NSString* string) {
 
 @end
 
-#define IMPLEMENTATION(__NAME__, __OPEN__, __CLOSE__) \
+#define IMPLEMENTATION(__NAME__, __OPEN__, __CLOSE__, __BOUNDARY__) \
 @implementation ParserNode##__NAME__ \
 \
 + (BOOL) isAtomic { \
     return NO; \
 } \
 \
++ (BOOL) isReparseBoundary { \
+    return __BOUNDARY__; \
+} \
+\
++ (NSString*) prefixCharacters { \
+    return [NSString stringWithFormat:@"%c", __OPEN__]; \
+} \
+\
++ (NSString*) suffixCharacters { \
+    return [NSString stringWithFormat:@"%c", __CLOSE__]; \
+} \
+\
 + (NSUInteger) isMatchingPrefix:(const unichar*)string maxLength:(NSUInteger)maxLength { \
     return *string == __OPEN__ ? 1 : NSNotFound; \
 } \
@@ -207,9 +303,9 @@ NSString* _StringFromHexUnicodeCharacter(NSString* string) {
 \
 @end
 
-IMPLEMENTATION(Braces, '{', '}')
-IMPLEMENTATION(Parenthesis, '(', ')')
-IMPLEMENTATION(Brackets, '[', ']')
+IMPLEMENTATION(Braces, '{', '}', YES)
+IMPLEMENTATION(Parenthesis, '(', ')', NO)
+IMPLEMENTATION(Brackets, '[', ']', YES)
 
 #undef IMPLEMENTATION
 
@@ -228,6 +324,8 @@ IMPLEMENTATION(Brackets, '[', ']')
 #define IMPLEMENTATION(__NAME__, __CHARACTERS__) \
 @implementation ParserNode##__NAME__ \
 \
+PREFIX_CHARACTERS_METHOD(__CHARACTERS__) \
+\
 + (NSUInteger) isMatchingPrefix:(const unichar*)string maxLength:(NSUInteger)maxLength { \
     IS_MATCHING_CHARACTERS(__CHARACTERS__, string, maxLength); \
     return _matching; \
@@ -255,6 +353,10 @@ IMPLEMENTATION(Arrow, "->")
 
 @implementation ParserNodeEscapedCharacter
 
++ (NSString*) prefixCharacters {
+    return @"\\";
+}
+
 + (NSUInteger) isMatchingPrefix:(const unichar*)string maxLength:(NSUInteger)maxLength {
     return (maxLength >= 2) && (*string == '\\') ? 2 : NSNotFound;
 }
@@ -288,6 +390,10 @@ IMPLEMENTATION(Arrow, "->")
     return [NSSet setWithObject:[ParserNodeEscapedCharacter class]];
 }
 
++ (NSString*) prefixCharacters {
+    return @"\\";
+}
+
 + (NSUInteger) isMatchingPrefix:(const unichar*)string maxLength:(NSUInteger)maxLength {
     if((maxLength >= 2) && (*string == '\\') && (*(string + 1) != '\\')) {
         if((*(string + 1) == 'x') && (maxLength >= 4)) {
@@ -19,25 +19,34 @@
 #import <Foundation/Foundation.h>
 
 @class ParserNode;
+struct ParserArena;
 
 typedef ParserNode* (*ParserNodeApplierFunction)(ParserNode* node, void* context); //Return a node whose children to process for recursive operations
 
 /* Abstract class: do not instantiate */
 @interface ParserNode : NSObject <NSCopying> {
+@package
+    NSUInteger _kind; //Dense identifier of the node class
 @private
     NSString* _text;
     NSRange _range;
-    NSRange _lines;
     ParserNode* _parent;
     NSMutableArray* _children;
+    NSUInteger _index; //Index in parent - Only valid if less than "_validChildIndexes" of parent
+    NSUInteger _validChildIndexes;
+    BOOL _modified; //Content may differ from "text" in "range"
+    NSString* _content;
+    NSString* _cleanContent;
     NSUInteger _revision;
     void* _jsObject;
+    struct ParserArena* _arena;
+    struct ChildKindIndex* _childKindIndex; //Only for nodes with many children
 }
 + (NSString*) name;
 
 @property(nonatomic, readonly) NSString* text;
 @property(nonatomic, readonly) NSRange range;
-@property(nonatomic, readonly) NSRange lines;
+@property(nonatomic, readonly) NSRange lines; //Computed from "range" using the line index of the root node - (0, 0) if not part of a tree
 @property(nonatomic, readonly) NSString* content;
 
 @property(nonatomic, readonly) NSString* name; //A name for the node whose definition depends on the node class - returns +name by default
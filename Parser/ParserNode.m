@@ -16,19 +16,301 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#import <objc/runtime.h>
+#import <pthread.h>
+
 #import "Parser_Internal.h"
 
+#define kArenaSlabSize (64 * 1024)
+#define kChildKindIndexMinimumChildren 32
+
+typedef struct ArenaSlab {
+    struct ArenaSlab* next;
+    NSUInteger used;
+    char bytes[] __attribute__((aligned(16))); //Each instance is preceded by its 16 bytes aligned size
+} ArenaSlab;
+
+/* All nodes carved out of an arena share its retain count and are destroyed together when it drops to zero - References held by parents on children from the same arena are not counted - The count is updated atomically since trees may be shared across threads */
+struct ParserArena {
+    NSUInteger retainCount;
+    BOOL destroying;
+    NSString* text;
+    ArenaSlab* slabs; //Most recent first
+};
+
 static IMP _nameMethod = NULL;
 static IMP _cleanContentMethod = NULL;
+static pthread_key_t _arenaKey;
+static pthread_key_t _recorderKey;
+static pthread_once_t _threadKeysOnce = PTHREAD_ONCE_INIT;
+static NSUInteger _liveArenas = 0;
+
+static void _CreateThreadKeys() {
+    pthread_key_create(&_arenaKey, NULL);
+    pthread_key_create(&_recorderKey, NULL);
+}
+
+ParserArena* _ParserArenaCreate(NSString* text) {
+    ParserArena* arena = calloc(1, sizeof(ParserArena));
+    arena->retainCount = 1;
+    arena->text = [text retain];
+    __sync_add_and_fetch(&_liveArenas, 1);
+    return arena;
+}
+
+void _ParserArenaRelease(ParserArena* arena) {
+    if(arena->destroying || __sync_sub_and_fetch(&arena->retainCount, 1)) {
+        return;
+    }
+    
+    //Run -dealloc on all instances first so that they can still message each other, then destroy them all at once
+    arena->destroying = YES;
+    for(ArenaSlab* slab = arena->slabs; slab; slab = slab->next) {
+        for(NSUInteger offset = 0; offset < slab->used; offset += 16 + *(NSUInteger*)&slab->bytes[offset]) {
+            [(id)&slab->bytes[offset + 16] dealloc];
+        }
+    }
+    ArenaSlab* slab = arena->slabs;
+    while(slab) {
+        ArenaSlab* next = slab->next;
+        for(NSUInteger offset = 0; offset < slab->used; offset += 16 + *(NSUInteger*)&slab->bytes[offset]) {
+            objc_destructInstance((id)&slab->bytes[offset + 16]);
+        }
+        free(slab);
+        slab = next;
+    }
+    [arena->text release];
+    free(arena);
+    __sync_sub_and_fetch(&_liveArenas, 1);
+}
+
+NSUInteger _ParserArenaLiveCount() {
+    return _liveArenas;
+}
+
+ParserArena* _ParserArenaSetCurrent(ParserArena* arena) {
+    pthread_once(&_threadKeysOnce, _CreateThreadKeys);
+    ParserArena* previous = pthread_getspecific(_arenaKey);
+    pthread_setspecific(_arenaKey, arena);
+    return previous;
+}
+
+/* Parents with many children index them by kind once linear sibling searches have cost as much as building the index, which is discarded whenever the children change */
+typedef struct ChildKindIndex {
+    NSUInteger scannedChildren; //By linear searches since the children last changed
+    NSUInteger kindCount; //Of the children
+    NSUInteger* kinds; //NULL until built - Allocated together with "starts" and "indexes"
+    NSUInteger* starts; //Offset in "indexes" of the children of each kind followed by the number of children
+    NSUInteger* indexes; //Child indexes grouped by kind in increasing order
+} ChildKindIndex;
+
+typedef struct {
+    ParserNode* node;
+    NSUInteger sequence;
+    NSUInteger location; //Only valid while ordering nodes created after the tree was built
+    NSUInteger depth; //Idem
+} RecordedNode;
+
+typedef struct {
+    RecordedNode* nodes;
+    NSUInteger count;
+    NSUInteger capacity;
+} RecordedNodeList;
+
+/* Nodes are recorded per kind in creation order, which is also depth-first order for all nodes created while building a tree */
+struct ParserNodeRecorder {
+    NSUInteger sequence; //Of the next recorded node
+    NSUInteger orderedSequence; //Nodes recorded before this sequence were created while building the tree
+    RecordedNodeList* lists; //Indexed by kind
+    CFMutableDictionaryRef retypedNodes; //Latest sequence of nodes recorded again after changing kind
+};
+
+ParserNodeRecorder* _ParserNodeRecorderCreate() {
+    ParserNodeRecorder* recorder = calloc(1, sizeof(ParserNodeRecorder));
+    recorder->orderedSequence = NSNotFound;
+    recorder->lists = calloc(_kindCount, sizeof(RecordedNodeList));
+    return recorder;
+}
+
+void _ParserNodeRecorderRelease(ParserNodeRecorder* recorder) {
+    for(NSUInteger i = 0; i < _kindCount; ++i) {
+        for(NSUInteger j = 0; j < recorder->lists[i].count; ++j) {
+            [recorder->lists[i].nodes[j].node release];
+        }
+        free(recorder->lists[i].nodes);
+    }
+    free(recorder->lists);
+    if(recorder->retypedNodes) {
+        CFRelease(recorder->retypedNodes);
+    }
+    free(recorder);
+}
+
+ParserNodeRecorder* _ParserNodeRecorderSetCurrent(ParserNodeRecorder* recorder) {
+    pthread_once(&_threadKeysOnce, _CreateThreadKeys);
+    ParserNodeRecorder* previous = pthread_getspecific(_recorderKey);
+    pthread_setspecific(_recorderKey, recorder);
+    return previous;
+}
+
+void _ParserNodeRecorderEndOrderedNodes(ParserNodeRecorder* recorder) {
+    recorder->orderedSequence = recorder->sequence;
+}
+
+static void _RecordNode(ParserNodeRecorder* recorder, ParserNode* node) {
+    RecordedNodeList* list = &recorder->lists[node->_kind];
+    if(list->count == list->capacity) {
+        list->capacity = list->capacity ? 2 * list->capacity : 16;
+        list->nodes = realloc(list->nodes, list->capacity * sizeof(RecordedNode));
+    }
+    list->nodes[list->count].node = [node retain]; //Nodes must outlive the recorder even if syntax analysis removes them from the tree
+    list->nodes[list->count].sequence = recorder->sequence++;
+    ++list->count;
+}
+
+typedef struct {
+    Class class;
+    NSUInteger kind;
+} KindEntry;
+
+NSUInteger _kindCount = 0;
+static Class* _kindClasses = NULL; //Indexed by kind
+static KindEntry* _kindEntries = NULL; //Open addressing hash table from classes to kinds
+static NSUInteger _kindEntryMask = 0;
+NSUInteger _kindMaskWords = 0;
+const uint64_t* _kindMasks = NULL;
+
+static inline NSUInteger _HashClass(Class class) {
+    return ((uintptr_t)class >> 4) & _kindEntryMask;
+}
+
+static int _CompareClassNames(const void* class1, const void* class2) {
+    return strcmp(class_getName(*(Class*)class1), class_getName(*(Class*)class2));
+}
+
+/* Kinds are assigned once to ParserNode and all its subclasses linked in the process, in name order, since syntax analysis creates node classes languages do not list and trees can mix languages */
+static void _BuildKinds() {
+    int count = objc_getClassList(NULL, 0);
+    Class* list = malloc(MAX(count, 1) * sizeof(Class));
+    count = objc_getClassList(list, count);
+    _kindClasses = malloc(MAX(count, 1) * sizeof(Class));
+    for(int i = 0; i < count; ++i) {
+        for(Class class = list[i]; class; class = class_getSuperclass(class)) {
+            if(class == [ParserNode class]) {
+                _kindClasses[_kindCount++] = list[i];
+                break;
+            }
+        }
+    }
+    free(list);
+    qsort(_kindClasses, _kindCount, sizeof(Class), _CompareClassNames);
+    
+    _kindEntryMask = 1;
+    while(_kindEntryMask < 2 * _kindCount) {
+        _kindEntryMask *= 2;
+    }
+    _kindEntries = calloc(_kindEntryMask, sizeof(KindEntry));
+    _kindEntryMask -= 1;
+    for(NSUInteger kind = 0; kind < _kindCount; ++kind) {
+        NSUInteger index = _HashClass(_kindClasses[kind]);
+        while(_kindEntries[index].class) {
+            index = (index + 1) & _kindEntryMask;
+        }
+        _kindEntries[index].class = _kindClasses[kind];
+        _kindEntries[index].kind = kind;
+    }
+    
+    _kindMaskWords = (_kindCount + 63) / 64;
+    uint64_t* masks = calloc(MAX(_kindCount * _kindMaskWords, 1), sizeof(uint64_t));
+    for(NSUInteger kind = 0; kind < _kindCount; ++kind) {
+        for(Class class = _kindClasses[kind]; class != [NSObject class]; class = class_getSuperclass(class)) {
+            _AddKindToMask(_KindOfClass(class), &masks[kind * _kindMaskWords]);
+        }
+    }
+    _kindMasks = masks;
+}
+
+NSUInteger _KindOfClass(Class class) {
+    if(class) {
+        NSUInteger index = _HashClass(class);
+        while(_kindEntries[index].class) {
+            if(_kindEntries[index].class == class) {
+                return _kindEntries[index].kind;
+            }
+            index = (index + 1) & _kindEntryMask;
+        }
+    }
+    return NSNotFound;
+}
+
+Class _ClassOfKind(NSUInteger kind) {
+    return kind < _kindCount ? _kindClasses[kind] : Nil;
+}
+
+void _AddClassToKindMask(Class class, uint64_t* mask) {
+    NSUInteger kind = _KindOfClass(class);
+    if(kind != NSNotFound) {
+        _AddKindToMask(kind, mask);
+    } else if(class && [ParserNode isSubclassOfClass:class]) { //All nodes are a kind of a superclass of ParserNode
+        _AddKindToMask(_KindOfClass([ParserNode class]), mask);
+    }
+}
 
 @implementation ParserNode
 
-@synthesize text=_text, range=_range, lines=_lines, parent=_parent, children=_children, revision=_revision, jsObject=_jsObject;
+@synthesize text=_text, range=_range, parent=_parent, children=_children, revision=_revision, jsObject=_jsObject, modified=_modified;
+
+static id _ParserArenaAllocateInstance(ParserArena* arena, Class class) {
+    NSUInteger size = (class_getInstanceSize(class) + 15) & ~15;
+    ArenaSlab* slab = arena->slabs;
+    if((slab == NULL) || (slab->used + 16 + size > kArenaSlabSize - sizeof(ArenaSlab))) {
+        slab = malloc(MAX(kArenaSlabSize, sizeof(ArenaSlab) + 16 + size));
+        slab->next = arena->slabs;
+        slab->used = 0;
+        arena->slabs = slab;
+    }
+    char* bytes = &slab->bytes[slab->used];
+    *(NSUInteger*)bytes = size;
+    bzero(bytes + 16, size);
+    slab->used += 16 + size;
+    
+    ParserNode* node = objc_constructInstance(class, bytes + 16);
+    node->_arena = arena;
+    __sync_add_and_fetch(&arena->retainCount, 1);
+    return node;
+}
+
+static void _SetKind(ParserNode* node, Class class) {
+    while((node->_kind = _KindOfClass(class)) == NSNotFound) { //Classes created after kinds were assigned use the kind of their closest superclass
+        class = class_getSuperclass(class);
+    }
+}
+
+static void _InvalidateChildKindIndex(ParserNode* node) {
+    if(node->_childKindIndex) {
+        free(node->_childKindIndex->kinds);
+        free(node->_childKindIndex);
+        node->_childKindIndex = NULL;
+    }
+}
+
+static void _InvalidateContent(ParserNode* node) {
+    while(node && !(node->_modified && (node->_content == nil) && (node->_cleanContent == nil))) {
+        [node->_content release];
+        node->_content = nil;
+        [node->_cleanContent release];
+        node->_cleanContent = nil;
+        node->_modified = YES;
+        node = node->_parent;
+    }
+}
 
 + (void) initialize {
     if(self == [ParserNode class]) {
         _nameMethod = [ParserNode instanceMethodForSelector:@selector(name)];
         _cleanContentMethod = [ParserNode instanceMethodForSelector:@selector(cleanContent)];
+        pthread_once(&_threadKeysOnce, _CreateThreadKeys);
+        _BuildKinds();
     }
 }
 
@@ -37,7 +319,19 @@ static IMP _cleanContentMethod = NULL;
         [NSException raise:NSInternalInconsistencyException format:@"ParserNode is an abstract class"];
     }
     
-    return [super allocWithZone:zone];
+    ParserNode* node;
+    ParserArena* arena = pthread_getspecific(_arenaKey);
+    if(arena && ![self isSubclassOfClass:[ParserNodeRoot class]]) { //Roots are never part of the arena so that they can be the last reference to it
+        node = _ParserArenaAllocateInstance(arena, self);
+    } else {
+        node = [super allocWithZone:zone];
+    }
+    _SetKind(node, self);
+    ParserNodeRecorder* recorder = pthread_getspecific(_recorderKey);
+    if(recorder) {
+        _RecordNode(recorder, node);
+    }
+    return node;
 }
 
 + (NSSet*) patchedClasses {
@@ -48,6 +342,22 @@ static IMP _cleanContentMethod = NULL;
     return YES;
 }
 
++ (NSString*) prefixCharacters {
+    return nil;
+}
+
++ (NSString*) suffixCharacters {
+    return nil;
+}
+
++ (const ParserNodeTerminator*) terminator {
+    return NULL;
+}
+
++ (const ParserNodeKeywordDefinition*) keywordDefinition {
+    return NULL;
+}
+
 + (NSUInteger) isMatchingPrefix:(const unichar*)string maxLength:(NSUInteger)maxLength {
     return NSNotFound;
 }
@@ -56,27 +366,66 @@ static IMP _cleanContentMethod = NULL;
     return 0;
 }
 
++ (BOOL) isReparseBoundary {
+    return NO;
+}
+
 + (NSString*) name {
     return [NSStringFromClass(self) substringFromIndex:[@"ParserNode" length]];
 }
 
 - (id) initWithText:(NSString*)text range:(NSRange)range {
     if((self = [super init])) {
-        _text = [text copy];
+        _text = _arena && (text == _arena->text) ? text : [text copy]; //The arena already retains the parsed text
         _range = range;
     }
     
     return self;
 }
 
+- (void) setRange:(NSRange)range {
+    _range = range;
+    _InvalidateContent(self);
+}
+
+- (id) retain {
+    if(_arena) {
+        __sync_add_and_fetch(&_arena->retainCount, 1);
+        return self;
+    }
+    return [super retain];
+}
+
+- (oneway void) release {
+    if(_arena) {
+        _ParserArenaRelease(_arena);
+        return;
+    }
+    [super release];
+}
+
+- (NSUInteger) retainCount {
+    return _arena ? _arena->retainCount : [super retainCount];
+}
+
 - (void) dealloc {
     for(ParserNode* node in _children) {
-        node.parent = nil;
+        if(!_arena || (node->_arena != _arena)) { //Children from the same arena are being destroyed as well
+            node.parent = nil;
+        }
     }
     [_children release];
+    _InvalidateChildKindIndex(self);
     
-    [_text release];
+    [_content release];
+    [_cleanContent release];
+    if(!_arena || (_text != _arena->text)) {
+        [_text release];
+    }
     
+    if(_arena) { //Memory is reclaimed by the arena
+        return;
+    }
     [super dealloc];
 }
 
@@ -85,7 +434,6 @@ static IMP _cleanContentMethod = NULL;
     if(copy) {
         copy->_text = [_text retain];
         copy->_range = _range;
-        copy->_lines = _lines;
         //node->_parent = nil;
         //node->_children = nil;
         //node->_revision = 0;
@@ -104,8 +452,23 @@ static IMP _cleanContentMethod = NULL;
     return copy;
 }
 
-- (NSMutableArray*) mutableChildren {
-    return _children;
+static ParserNode* _RootOfTree(ParserNode* node) {
+    while(node->_parent) {
+        node = node->_parent;
+    }
+    return node;
+}
+
+//Callers iterating over a tree should look up "root" once
+static NSRange _LinesInTree(ParserNode* node, ParserNode* root) {
+    if(IS_KIND(root, Root) && (root->_text == node->_text)) {
+        return [(ParserNodeRoot*)root linesForRange:node->_range];
+    }
+    return NSMakeRange(0, 0);
+}
+
+- (NSRange) lines {
+    return _LinesInTree(self, _RootOfTree(self));
 }
 
 - (ParserNode*) firstChild {
@@ -116,14 +479,26 @@ static IMP _cleanContentMethod = NULL;
     return [_children objectAtIndex:(_children.count - 1)];
 }
 
+//Children cache their index which parents renumber lazily after insertions or removals before the end
+static inline NSUInteger _IndexInParent(ParserNode* node) {
+    ParserNode* parent = node->_parent;
+    if(node->_index >= parent->_validChildIndexes) {
+        NSUInteger count = parent->_children.count;
+        for(NSUInteger i = parent->_validChildIndexes; i < count; ++i) {
+            ((ParserNode*)[parent->_children objectAtIndex:i])->_index = i;
+        }
+        parent->_validChildIndexes = count;
+    }
+    return node->_index;
+}
+
 - (ParserNode*) previousSibling {
     if(_parent == nil) {
         [NSException raise:NSInternalInconsistencyException format:@"%@ has no parent", self];
     }
     
-    NSArray* children = _parent.children;
-    NSUInteger index = [children indexOfObject:self];
-    return index > 0 ? [children objectAtIndex:(index - 1)] : nil;
+    NSUInteger index = _IndexInParent(self);
+    return index > 0 ? [_parent->_children objectAtIndex:(index - 1)] : nil;
 }
 
 - (ParserNode*) nextSibling {
@@ -131,46 +506,202 @@ static IMP _cleanContentMethod = NULL;
         [NSException raise:NSInternalInconsistencyException format:@"%@ has no parent", self];
     }
     
-    NSArray* children = _parent.children;
-    NSUInteger index = [children indexOfObject:self];
+    NSArray* children = _parent->_children;
+    NSUInteger index = _IndexInParent(self);
     return index < children.count - 1 ? [children objectAtIndex:(index + 1)] : nil;
 }
 
-static void _MergeChildrenContent(ParserNode* node, NSMutableString* string) {
-    for(node in node.children) {
-        if(node.children) {
-            _MergeChildrenContent(node, string);
+/* Merged contents of branches are cached, which also caches them for all branches below
+   As a result, if a node is modified and has no cache, neither do its parents, which lets invalidation stop there */
+static void _RecordRetypedNode(ParserNodeRecorder* recorder, ParserNode* node) {
+    if(recorder->retypedNodes == NULL) {
+        recorder->retypedNodes = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, NULL);
+    }
+    CFDictionarySetValue(recorder->retypedNodes, node, (const void*)recorder->sequence);
+    _RecordNode(recorder, node);
+}
+
+NSUInteger _DepthInTree(ParserNode* node, ParserNode* root, CFSetRef excludedNodes) {
+    NSUInteger depth = 0;
+    while(1) {
+        if((node == nil) || (excludedNodes && CFSetContainsValue(excludedNodes, node))) {
+            return NSNotFound;
+        }
+        if(node == root) {
+            return depth;
+        }
+        node = node->_parent;
+        ++depth;
+    }
+}
+
+static int _CompareRecordedNodeSequences(const void* node1, const void* node2) {
+    NSUInteger sequence1 = ((const RecordedNode*)node1)->sequence;
+    NSUInteger sequence2 = ((const RecordedNode*)node2)->sequence;
+    return sequence1 < sequence2 ? -1 : (sequence1 > sequence2 ? 1 : 0);
+}
+
+static int _CompareRecordedNodePositions(const void* node1, const void* node2) {
+    const RecordedNode* recordedNode1 = (const RecordedNode*)node1;
+    const RecordedNode* recordedNode2 = (const RecordedNode*)node2;
+    if(recordedNode1->location != recordedNode2->location) {
+        return recordedNode1->location < recordedNode2->location ? -1 : 1;
+    }
+    if(recordedNode1->depth != recordedNode2->depth) { //Ancestors come before descendants starting at the same location
+        return recordedNode1->depth < recordedNode2->depth ? -1 : 1;
+    }
+    return _CompareRecordedNodeSequences(node1, node2);
+}
+
+/* Nodes created by syntax analysis are appended out of order, so they are sorted by position and merged with the others, which only requires computing positions when there are any */
+ParserNode** _CopyRecordedNodesInTree(ParserNodeRecorder* recorder, const ParserSyntaxAnalysisFunction* functions, ParserNode* root, NSUInteger* count) {
+    NSUInteger total = 0;
+    NSUInteger lists = 0;
+    for(NSUInteger i = 0; i < _kindCount; ++i) {
+        if(functions[i] && recorder->lists[i].count) {
+            total += recorder->lists[i].count;
+            ++lists;
+        }
+    }
+    RecordedNode* nodes = malloc(total * sizeof(RecordedNode));
+    NSUInteger orderedCount = 0;
+    NSUInteger unorderedCount = 0;
+    for(NSUInteger i = 0; i < _kindCount; ++i) {
+        if(functions[i]) {
+            for(NSUInteger j = 0; j < recorder->lists[i].count; ++j) {
+                RecordedNode* node = &recorder->lists[i].nodes[j];
+                if(node->node->_kind != i) { //Retyped nodes are recorded again under their new kind
+                    continue;
+                }
+                const void* sequence;
+                if(recorder->retypedNodes && CFDictionaryGetValueIfPresent(recorder->retypedNodes, node->node, &sequence) && ((NSUInteger)sequence != node->sequence)) {
+                    continue;
+                }
+                if(node->sequence < recorder->orderedSequence) {
+                    nodes[orderedCount++] = *node;
+                } else {
+                    nodes[total - ++unorderedCount] = *node;
+                }
+            }
+        }
+    }
+    if(orderedCount + unorderedCount < total) {
+        memmove(&nodes[orderedCount], &nodes[total - unorderedCount], unorderedCount * sizeof(RecordedNode));
+        total = orderedCount + unorderedCount;
+    }
+    if(lists > 1) {
+        qsort(nodes, orderedCount, sizeof(RecordedNode), _CompareRecordedNodeSequences);
+    }
+    
+    ParserNode** result = malloc(total * sizeof(ParserNode*));
+    *count = 0;
+    if(unorderedCount) {
+        for(NSUInteger i = 0; i < total; ++i) {
+            nodes[i].location = nodes[i].node->_range.location;
+            nodes[i].depth = _DepthInTree(nodes[i].node, root, NULL);
+        }
+        qsort(&nodes[orderedCount], unorderedCount, sizeof(RecordedNode), _CompareRecordedNodePositions);
+        NSUInteger i = 0;
+        NSUInteger j = orderedCount;
+        while((i < orderedCount) || (j < total)) {
+            RecordedNode* node;
+            if((j == total) || ((i < orderedCount) && (_CompareRecordedNodePositions(&nodes[i], &nodes[j]) < 0))) {
+                node = &nodes[i++];
+            } else {
+                node = &nodes[j++];
+            }
+            if(node->depth != NSNotFound) {
+                result[(*count)++] = node->node;
+            }
+        }
+    } else {
+        for(NSUInteger i = 0; i < orderedCount; ++i) {
+            result[(*count)++] = nodes[i].node;
+        }
+    }
+    free(nodes);
+    return result;
+}
+
+//Returns YES if the content of "node" is "text" in its range - The tree must be consistent
+BOOL _MarkNodeUnmodified(ParserNode* node, NSString* text) {
+    if(node->_text != text) {
+        return NO;
+    }
+    if(node->_modified) {
+        BOOL pristine = YES;
+        for(ParserNode* child in node->_children) {
+            if(!_MarkNodeUnmodified(child, text)) {
+                pristine = NO;
+            }
+        }
+        node->_modified = !pristine;
+    }
+    return !node->_modified;
+}
+
+//Cached contents stay valid since nodes keep the same characters
+void _ShiftNodeTree(ParserNode* node, NSString* text, NSRange editedRange, NSInteger delta, ParserNode* skippedNode) {
+    if(node == skippedNode) {
+        return;
+    }
+    
+    if(node->_text != text) {
+        if(!node->_arena || (node->_text != node->_arena->text)) {
+            [node->_text release];
+        }
+        node->_text = [text retain];
+    }
+    if(node->_range.location >= editedRange.location + editedRange.length) {
+        node->_range.location += delta;
+    } else if(node->_range.location + node->_range.length > editedRange.location) {
+        node->_range.length += delta;
+    }
+    
+    for(ParserNode* child in node->_children) {
+        _ShiftNodeTree(child, text, editedRange, delta, skippedNode);
+    }
+}
+
+static NSString* _MergedContent(ParserNode* node) {
+    if(node->_content == nil) {
+        if(node->_modified) {
+            NSMutableString* string = [[NSMutableString alloc] initWithCapacity:node->_range.length];
+            for(ParserNode* child in node->_children) {
+                [string appendString:(child->_children ? _MergedContent(child) : child.content)];
+            }
+            node->_content = [string copy];
+            [string release];
         } else {
-            [string appendString:node.content];
+            node->_content = [[node->_text substringWithRange:node->_range] retain];
         }
     }
+    return node->_content;
 }
 
 - (NSString*) content {
     if(_children) {
-        NSMutableString* string = [NSMutableString stringWithCapacity:_range.length];
-        _MergeChildrenContent(self, string);
-        return string;
+        return [[_MergedContent(self) retain] autorelease];
     }
     
     return [_text substringWithRange:_range];
 }
 
-static void _MergeChildrenCleanContent(ParserNode* node, NSMutableString* string) {
-    for(node in node.children) {
-        if(node.children) {
-            _MergeChildrenCleanContent(node, string);
-        } else {
-            [string appendString:node.cleanContent];
+static NSString* _MergedCleanContent(ParserNode* node) {
+    if(node->_cleanContent == nil) {
+        NSMutableString* string = [[NSMutableString alloc] initWithCapacity:node->_range.length];
+        for(ParserNode* child in node->_children) {
+            [string appendString:(child->_children ? _MergedCleanContent(child) : child.cleanContent)];
         }
+        node->_cleanContent = [string copy];
+        [string release];
     }
+    return node->_cleanContent;
 }
 
 - (NSString*) cleanContent {
     if(_children) {
-        NSMutableString* string = [NSMutableString stringWithCapacity:_range.length];
-        _MergeChildrenCleanContent(self, string);
-        return string;
+        return [[_MergedCleanContent(self) retain] autorelease];
     }
     
     return self.content;
@@ -201,7 +732,7 @@ static void _MergeChildrenCleanContent(ParserNode* node, NSMutableString* string
         [NSException raise:NSInternalInconsistencyException format:@"%@ is not a child of %@", child, self];
     }
     
-    return [_children indexOfObject:child];
+    return _IndexInParent(child);
 }
 
 - (void) insertChild:(ParserNode*)child atIndex:(NSUInteger)index {
@@ -213,16 +744,33 @@ static void _MergeChildrenCleanContent(ParserNode* node, NSMutableString* string
         _children = [[NSMutableArray alloc] init];
     }
     
+    if((index == _validChildIndexes) && (index == _children.count)) {
+        ++_validChildIndexes;
+    } else {
+        _validChildIndexes = MIN(_validChildIndexes, index);
+    }
     [_children insertObject:child atIndex:index];
+    if(_arena && (child->_arena == _arena)) {
+        __sync_sub_and_fetch(&_arena->retainCount, 1); //Don't count the reference since the child is destroyed along with its parent
+    }
+    _InvalidateChildKindIndex(self);
+    child->_index = index;
     child.parent = self;
+    _InvalidateContent(self);
 }
 
 - (void) removeChildAtIndex:(NSUInteger)index {
     ParserNode* node = [_children objectAtIndex:index];
     [node retain];
     node.parent = nil;
+    if(_arena && (node->_arena == _arena)) {
+        __sync_add_and_fetch(&_arena->retainCount, 1); //Balance the release of the uncounted reference
+    }
     [_children removeObjectAtIndex:index];
+    _InvalidateChildKindIndex(self);
     [node autorelease];
+    _validChildIndexes = MIN(_validChildIndexes, index);
+    _InvalidateContent(self);
     
     if(!_children.count) {
         [_children release];
@@ -230,6 +778,59 @@ static void _MergeChildrenCleanContent(ParserNode* node, NSMutableString* string
     }
 }
 
+/* Unlike moving children one by one, this shifts each children array once and does not need to look up the indexes of the moved children */
+void _MoveChildren(ParserNode* parent, NSRange range, ParserNode* newParent, NSUInteger index) {
+    if(range.length == 0) {
+        return;
+    }
+    if(newParent == parent) {
+        [NSException raise:NSInternalInconsistencyException format:@"Cannot move children of %@ to itself", parent];
+    }
+    
+    NSArray* nodes = [parent->_children subarrayWithRange:range]; //Keeps the nodes alive until the autorelease pool is drained
+    if(parent->_arena) {
+        for(ParserNode* node in nodes) {
+            if(node->_arena == parent->_arena) {
+                __sync_add_and_fetch(&parent->_arena->retainCount, 1); //Balance the release of the uncounted reference
+            }
+        }
+    }
+    [parent->_children removeObjectsInRange:range];
+    _InvalidateChildKindIndex(parent);
+    parent->_validChildIndexes = MIN(parent->_validChildIndexes, range.location);
+    _InvalidateContent(parent);
+    if(!parent->_children.count) {
+        [parent->_children release];
+        parent->_children = nil;
+    }
+    
+    if(newParent) {
+        if(newParent->_children == nil) {
+            newParent->_children = [[NSMutableArray alloc] init];
+        }
+        BOOL appending = (index == newParent->_validChildIndexes) && (index == newParent->_children.count);
+        [newParent->_children replaceObjectsInRange:NSMakeRange(index, 0) withObjectsFromArray:nodes];
+        if(newParent->_arena) {
+            for(ParserNode* node in nodes) {
+                if(node->_arena == newParent->_arena) {
+                    __sync_sub_and_fetch(&newParent->_arena->retainCount, 1); //Don't count the reference since the child is destroyed along with its parent
+                }
+            }
+        }
+        _InvalidateChildKindIndex(newParent);
+        if(appending) {
+            newParent->_validChildIndexes += range.length;
+        } else {
+            newParent->_validChildIndexes = MIN(newParent->_validChildIndexes, index);
+        }
+        _InvalidateContent(newParent);
+    }
+    for(ParserNode* node in nodes) {
+        node->_index = index++;
+        node->_parent = newParent;
+    }
+}
+
 - (void) insertPreviousSibling:(ParserNode*)sibling {
     if(_parent == nil) {
         [NSException raise:NSInternalInconsistencyException format:@"%@ has no parent", self];
@@ -250,12 +851,6 @@ static void _MergeChildrenCleanContent(ParserNode* node, NSMutableString* string
     [self replaceWithNode:node preserveChildren:NO];
 }
 
-static ParserNode* _ApplierFunction(ParserNode* node, void* context) {
-    [node removeFromParent];
-    [(ParserNode*)context addChild:node];
-    return nil;
-}
-
 - (void) replaceWithNode:(ParserNode*)node preserveChildren:(BOOL)preserveChildren {
     if(_parent == nil) {
         [NSException raise:NSInternalInconsistencyException format:@"%@ has no parent", self];
@@ -267,128 +862,229 @@ static ParserNode* _ApplierFunction(ParserNode* node, void* context) {
     if(node) {
         [parent insertChild:node atIndex:index];
         if(preserveChildren) {
-            [self applyFunctionOnChildren:_ApplierFunction context:node];
+            _MoveChildren(self, NSMakeRange(0, _children.count), node, node->_children.count);
         }
     } else if(preserveChildren) {
-        for(node in [_children reverseObjectEnumerator]) {
-            [node removeFromParent];
-            [parent insertChild:node atIndex:index];
-        }
+        _MoveChildren(self, NSMakeRange(0, _children.count), parent, index);
     }
 }
 
+//Returns YES if instances of "class" and "otherClass" have the same instance variables
+static BOOL _IsLayoutCompatible(Class class, Class otherClass) {
+    size_t size = class_getInstanceSize(class);
+    if(class_getInstanceSize(otherClass) != size) {
+        return NO;
+    }
+    Class ancestor = otherClass;
+    while(ancestor && ![class isSubclassOfClass:ancestor]) {
+        ancestor = class_getSuperclass(ancestor);
+    }
+    return ancestor && (class_getInstanceSize(ancestor) == size);
+}
+
+/* Preserving children only needs to change the class of the node if the new one has the same instance variables, which keeps its identity and position as well */
 - (ParserNode*) replaceWithNodeOfClass:(Class)class preserveChildren:(BOOL)preserveChildren {
+    if(preserveChildren && _IsLayoutCompatible(object_getClass(self), class)) {
+        if(_parent == nil) {
+            [NSException raise:NSInternalInconsistencyException format:@"%@ has no parent", self];
+        }
+        
+        NSUInteger kind = _kind;
+        object_setClass(self, class);
+        _SetKind(self, class);
+        _InvalidateChildKindIndex(_parent);
+        _InvalidateContent(self);
+        ParserNodeRecorder* recorder = pthread_getspecific(_recorderKey);
+        if(recorder && (_kind != kind)) {
+            _RecordRetypedNode(recorder, self);
+        }
+        return self;
+    }
+    
     ParserNode* node = [[class alloc] initWithText:self.text range:self.range];
-    node.lines = self.lines;
     [self replaceWithNode:node preserveChildren:preserveChildren];
     [node release];
     return node;
 }
 
-- (ParserNode*) findPreviousSiblingOfClass:(Class)class {
-    ParserNode* node = self.previousSibling;
-    while(node) {
-        if([node isKindOfClass:class]) {
-            return node;
+static void _BuildChildKindIndex(ParserNode* parent, ChildKindIndex* kindIndex) {
+    NSUInteger count = parent->_children.count;
+    NSUInteger* offsets = calloc(_kindCount, sizeof(NSUInteger));
+    NSUInteger kindCount = 0;
+    for(NSUInteger i = 0; i < count; ++i) {
+        ParserNode* child = [parent->_children objectAtIndex:i];
+        if(offsets[child->_kind]++ == 0) {
+            ++kindCount;
         }
-        node = node.previousSibling;
     }
-    return nil;
+    
+    NSUInteger* buffer = malloc((2 * kindCount + 1 + count) * sizeof(NSUInteger));
+    kindIndex->kindCount = kindCount;
+    kindIndex->kinds = buffer;
+    kindIndex->starts = &buffer[kindCount];
+    kindIndex->indexes = &buffer[2 * kindCount + 1];
+    NSUInteger offset = 0;
+    for(NSUInteger kind = 0, i = 0; kind < _kindCount; ++kind) {
+        if(offsets[kind]) {
+            kindIndex->kinds[i] = kind;
+            kindIndex->starts[i++] = offset;
+            NSUInteger kindChildren = offsets[kind];
+            offsets[kind] = offset;
+            offset += kindChildren;
+        }
+    }
+    kindIndex->starts[kindCount] = count;
+    for(NSUInteger i = 0; i < count; ++i) {
+        ParserNode* child = [parent->_children objectAtIndex:i];
+        kindIndex->indexes[offsets[child->_kind]++] = i;
+    }
+    free(offsets);
 }
 
-- (ParserNode*) findNextSiblingOfClass:(Class)class {
-    ParserNode* node = self.nextSibling;
-    while(node) {
-        if([node isKindOfClass:class]) {
-            return node;
+//Returns the index of the closest child to "index" in "kindIndex" going by "step" (and including "index") which is a kind of any kind in "mask" or NSNotFound
+static NSUInteger _FindIndexedChildOfAnyKind(ChildKindIndex* kindIndex, NSUInteger index, NSInteger step, const uint64_t* mask) {
+    NSUInteger result = NSNotFound;
+    for(NSUInteger i = 0; i < kindIndex->kindCount; ++i) {
+        if(!_IsKindOfAnyKind(kindIndex->kinds[i], mask)) {
+            continue;
+        }
+        NSUInteger start = kindIndex->starts[i];
+        NSUInteger end = kindIndex->starts[i + 1];
+        while(start < end) { //Find the first indexed child after "index"
+            NSUInteger middle = (start + end) / 2;
+            if(kindIndex->indexes[middle] < index) {
+                start = middle + 1;
+            } else {
+                end = middle;
+            }
+        }
+        if(step > 0) {
+            if((start < kindIndex->starts[i + 1]) && ((result == NSNotFound) || (kindIndex->indexes[start] < result))) {
+                result = kindIndex->indexes[start];
+            }
+        } else {
+            if((start < kindIndex->starts[i + 1]) && (kindIndex->indexes[start] == index)) {
+                return index;
+            }
+            if((start > kindIndex->starts[i]) && ((result == NSNotFound) || (kindIndex->indexes[start - 1] > result))) {
+                result = kindIndex->indexes[start - 1];
+            }
         }
-        node = node.nextSibling;
     }
-    return nil;
+    return result;
 }
 
-- (ParserNode*) findFirstChildOfClass:(Class)class {
-    ParserNode* node = self.firstChild;
-    while(node) {
-        if([node isKindOfClass:class]) {
-            return node;
+//Scans the children of "parent" from "index" by "step" (-1 wraps around the unsigned index to stop) for a node which is a kind of any kind in "mask"
+static ParserNode* _FindChildOfAnyKind(ParserNode* parent, NSUInteger index, NSInteger step, const uint64_t* mask) {
+    NSArray* children = parent->_children;
+    NSUInteger count = children.count;
+    if(index >= count) {
+        return nil;
+    }
+    
+    ChildKindIndex* kindIndex = parent->_childKindIndex;
+    if(count >= kChildKindIndexMinimumChildren) {
+        if(kindIndex == NULL) {
+            kindIndex = parent->_childKindIndex = calloc(1, sizeof(ChildKindIndex));
+        }
+        if((kindIndex->kinds == NULL) && (kindIndex->scannedChildren >= count)) {
+            _BuildChildKindIndex(parent, kindIndex);
+        }
+        if(kindIndex->kinds) {
+            index = _FindIndexedChildOfAnyKind(kindIndex, index, step, mask);
+            return index != NSNotFound ? [children objectAtIndex:index] : nil;
         }
-        node = node.nextSibling;
     }
-    return nil;
+    
+    NSUInteger start = index;
+    ParserNode* result = nil;
+    for(; index < count; index += step) {
+        ParserNode* node = [children objectAtIndex:index];
+        if(_IsNodeOfAnyKind(node, mask)) {
+            result = node;
+            break;
+        }
+    }
+    if(kindIndex) {
+        kindIndex->scannedChildren += (step > 0 ? MIN(index, count) - start : start - index);
+    }
+    return result;
 }
 
-- (ParserNode*) findLastChildOfClass:(Class)class {
-    ParserNode* node = self.lastChild;
-    while(node) {
-        if([node isKindOfClass:class]) {
-            return node;
-        }
-        node = node.previousSibling;
+static ParserNode* _FindSiblingOfAnyKind(ParserNode* node, NSInteger step, const uint64_t* mask) {
+    if(node->_parent == nil) {
+        [NSException raise:NSInternalInconsistencyException format:@"%@ has no parent", node];
     }
-    return nil;
+    
+    return _FindChildOfAnyKind(node->_parent, _IndexInParent(node) + step, step, mask);
+}
+
+- (ParserNode*) findPreviousSiblingOfClass:(Class)class {
+    KIND_MASK(mask);
+    _AddClassToKindMask(class, mask);
+    return _FindSiblingOfAnyKind(self, -1, mask);
+}
+
+- (ParserNode*) findNextSiblingOfClass:(Class)class {
+    KIND_MASK(mask);
+    _AddClassToKindMask(class, mask);
+    return _FindSiblingOfAnyKind(self, 1, mask);
+}
+
+- (ParserNode*) findFirstChildOfClass:(Class)class {
+    KIND_MASK(mask);
+    _AddClassToKindMask(class, mask);
+    return _FindChildOfAnyKind(self, 0, 1, mask);
+}
+
+- (ParserNode*) findLastChildOfClass:(Class)class {
+    KIND_MASK(mask);
+    _AddClassToKindMask(class, mask);
+    return _FindChildOfAnyKind(self, _children.count - 1, -1, mask);
 }
 
 - (ParserNode*) findPreviousSiblingOfAnyClass:(NSSet*)classes {
-    ParserNode* node = self.previousSibling;
-    while(node) {
-        for(Class class in classes) {
-            if([node isKindOfClass:class]) {
-                return node;
-            }
-        }
-        node = node.previousSibling;
+    KIND_MASK(mask);
+    for(Class class in classes) {
+        _AddClassToKindMask(class, mask);
     }
-    return nil;
+    return _FindSiblingOfAnyKind(self, -1, mask);
 }
 
 - (ParserNode*) findNextSiblingOfAnyClass:(NSSet*)classes {
-    ParserNode* node = self.nextSibling;
-    while(node) {
-        for(Class class in classes) {
-            if([node isKindOfClass:class]) {
-                return node;
-            }
-        }
-        node = node.nextSibling;
+    KIND_MASK(mask);
+    for(Class class in classes) {
+        _AddClassToKindMask(class, mask);
     }
-    return nil;
+    return _FindSiblingOfAnyKind(self, 1, mask);
 }
 
 - (ParserNode*) findFirstChildOfAnyClass:(NSSet*)classes {
-    ParserNode* node = self.firstChild;
-    while(node) {
-        for(Class class in classes) {
-            if([node isKindOfClass:class]) {
-                return node;
-            }
-        }
-        node = node.nextSibling;
+    KIND_MASK(mask);
+    for(Class class in classes) {
+        _AddClassToKindMask(class, mask);
     }
-    return nil;
+    return _FindChildOfAnyKind(self, 0, 1, mask);
 }
 
 - (ParserNode*) findLastChildOfAnyClass:(NSSet*)classes {
-    ParserNode* node = self.lastChild;
-    while(node) {
-        for(Class class in classes) {
-            if([node isKindOfClass:class]) {
-                return node;
-            }
-        }
-        node = node.previousSibling;
+    KIND_MASK(mask);
+    for(Class class in classes) {
+        _AddClassToKindMask(class, mask);
     }
-    return nil;
+    return _FindChildOfAnyKind(self, _children.count - 1, -1, mask);
 }
 
 - (NSUInteger) getDepthInParentsOfClass:(Class)class {
+    KIND_MASK(mask);
+    _AddClassToKindMask(class, mask);
     NSUInteger depth = 0;
     ParserNode* node = self;
-    while(node.parent) {
-        if(!class || [node.parent isKindOfClass:class]) {
+    while(node->_parent) {
+        if(!class || _IsNodeOfAnyKind(node->_parent, mask)) {
             ++depth;
         }
-        node = node.parent;
+        node = node->_parent;
     }
     return depth;
 }
@@ -415,12 +1111,12 @@ static void _ApplyFunction(ParserNode* node, NSUInteger revision, ParserNodeAppl
     }
 }
 
-static NSUInteger _globalRevision = 0;
+static NSUInteger _globalRevision = 0; //Updated atomically since trees can be processed on multiple threads
 
 - (void) applyFunctionOnChildren:(ParserNodeApplierFunction)function context:(void*)context {
     NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
     if(_children) {
-        _ApplyFunction(self, ++_globalRevision, function, context);
+        _ApplyFunction(self, __sync_add_and_fetch(&_globalRevision, 1), function, context);
     }
     [pool drain];
 }
@@ -452,7 +1148,7 @@ static void _ApplyBlock(ParserNode* node, NSUInteger revision, ParserNode* (^blo
 - (void) enumerateChildrenUsingBlock:(ParserNode* (^)(ParserNode* node))block {
     NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
     if(_children) {
-        _ApplyBlock(self, ++_globalRevision, block);
+        _ApplyBlock(self, __sync_add_and_fetch(&_globalRevision, 1), block);
     }
     [pool drain];
 }
@@ -497,7 +1193,7 @@ static void _AppendChildrenCompactDescription(ParserNode* node, NSMutableString*
             if(node == firstNode) {
                 [string appendFormat:@"%@%@", prefix, separator];
             }
-            if([node isMemberOfClass:[ParserNodeWhitespace class]] || [node isMemberOfClass:[ParserNodeNewline class]] || [node isMemberOfClass:[ParserNodeText class]]) {
+            if(IS_MEMBER_OF_KIND(node, Whitespace) || IS_MEMBER_OF_KIND(node, Newline) || IS_MEMBER_OF_KIND(node, Text)) {
                 [string appendFormat:@"%@%@", _FormatString(node.content), separator];
             } else {
                 [string appendFormat:@"|%@|%@", _FormatString(node.content), separator];
@@ -516,13 +1212,14 @@ static void _AppendChildrenCompactDescription(ParserNode* node, NSMutableString*
     return string;
 }
 
-static void _AppendNodeFullDescription(ParserNode* node, NSMutableString* string, NSString* prefix) {
+static void _AppendNodeFullDescription(ParserNode* node, NSMutableString* string, NSString* prefix, ParserNode* root) {
     static NSString* separator = @"♢"; //0x2662
     NSString* content = (node.children ? nil : _FormatString(node.content));
+    NSRange lines = _LinesInTree(node, root);
     if(content.length) {
-        [string appendFormat:@"%@[%lu:%lu] <%@> = %@%@%@\n", prefix, node.lines.location + 1, node.lines.location + node.lines.length, [[node class] name], separator, content, separator];
+        [string appendFormat:@"%@[%lu:%lu] <%@> = %@%@%@\n", prefix, lines.location + 1, lines.location + lines.length, [[node class] name], separator, content, separator];
     } else {
-        [string appendFormat:@"%@[%lu:%lu] <%@>\n", prefix, node.lines.location + 1, node.lines.location + node.lines.length, [[node class] name]];
+        [string appendFormat:@"%@[%lu:%lu] <%@>\n", prefix, lines.location + 1, lines.location + lines.length, [[node class] name]];
     }
     
     if([node methodForSelector:@selector(name)] != _nameMethod) {
@@ -543,20 +1240,21 @@ static void _AppendNodeFullDescription(ParserNode* node, NSMutableString* string
     if(node.children) {
         prefix = [prefix stringByAppendingString:@"|    "];
         for(node in node.children) {
-            _AppendNodeFullDescription(node, string, prefix);
+            _AppendNodeFullDescription(node, string, prefix, root);
         }
     }
 }
 
 - (NSString*) detailedDescription {
     NSMutableString* string = [NSMutableString string];
-    _AppendNodeFullDescription(self, string, @"");
+    _AppendNodeFullDescription(self, string, @"", _RootOfTree(self));
     [string deleteCharactersInRange:NSMakeRange(string.length - 1, 1)];
     return string;
 }
 
 - (NSString*) description {
-    return [NSString stringWithFormat:@"<%@ = %p | characters = [%lu, %lu] | lines = [%lu:%lu]>", [self class], self, (unsigned long)self.range.location, self.range.length, self.lines.location + 1, self.lines.location + self.lines.length];
+    NSRange lines = self.lines;
+    return [NSString stringWithFormat:@"<%@ = %p | characters = [%lu, %lu] | lines = [%lu:%lu]>", [self class], self, (unsigned long)self.range.location, self.range.length, lines.location + 1, lines.location + lines.length];
 }
 
 @end
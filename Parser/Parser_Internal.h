@@ -25,6 +25,18 @@
 #define IsWhitespaceOrNewline(C) (IsWhitespace(C) || IsNewline(C))
 #define IsAlphaNumerical(C) (((C >= 'a') && (C <= 'z')) || ((C >= 'A') && (C <= 'Z')) || ((C >= '0') && (C <= '9')))
 
+typedef struct {
+    const char* language; //Language prefix for keyword node classes (delimited by non-alphanumerical characters) or NULL
+    const char* characters;
+    BOOL trailingWhitespaceOrNewline; //If set or if "trailingCharacters" is not NULL, the next character must be whitespace, newline or in "trailingCharacters"
+    const char* trailingCharacters;
+} ParserNodeKeywordDefinition;
+
+typedef struct {
+    const char* characters; //Terminating characters which are part of the node
+    unichar escapeCharacter; //Character preventing the next one from being considered or 0 if none
+} ParserNodeTerminator;
+
 #define IS_MATCHING_CHARACTERS(__CHARACTERS__, __STRING__, __MAXLENGTH__) \
     const char* __characters = __CHARACTERS__; \
     NSUInteger __count = sizeof(__CHARACTERS__) - 1; \
@@ -46,13 +58,38 @@
         _matching = (__MAXLENGTH__ >= __count) && _EqualsCharacters(string, __characters, __count) ? __count : NSNotFound; \
     }
 
+#define PREFIX_CHARACTERS_METHOD(__CHARACTERS__) \
++ (NSString*) prefixCharacters { \
+    return [NSString stringWithFormat:@"%c", __CHARACTERS__[0]]; \
+}
+
+#define SUFFIX_CHARACTERS_METHOD(__CHARACTERS__) \
++ (NSString*) suffixCharacters { \
+    return [NSString stringWithFormat:@"%c", __CHARACTERS__[0]]; \
+}
+
+#define TERMINATOR_METHOD(__CHARACTERS__, __ESCAPE__) \
++ (const ParserNodeTerminator*) terminator { \
+    static const ParserNodeTerminator terminator = {__CHARACTERS__, __ESCAPE__}; \
+    return &terminator; \
+}
+
 #define IS_MATCHING_PREFIX_METHOD_WITH_TRAILING_CHARACTERS(__CHARACTERS__, __WHITESPACE_OR_NEWLINE__, __OTHER_CHARACTERS__) \
+PREFIX_CHARACTERS_METHOD(__CHARACTERS__) \
+\
++ (const ParserNodeKeywordDefinition*) keywordDefinition { \
+    static const ParserNodeKeywordDefinition definition = {NULL, __CHARACTERS__, __WHITESPACE_OR_NEWLINE__, __OTHER_CHARACTERS__}; \
+    return &definition; \
+} \
+\
 + (NSUInteger) isMatchingPrefix:(const unichar*)string maxLength:(NSUInteger)maxLength { \
     IS_MATCHING_CHARACTERS_EXTENDED(__CHARACTERS__, __WHITESPACE_OR_NEWLINE__, __OTHER_CHARACTERS__, string, maxLength) \
     return _matching; \
 }
 
 #define IS_MATCHING_SUFFIX_METHOD_WITH_TRAILING_CHARACTERS(__CHARACTERS__, __WHITESPACE_OR_NEWLINE__, __OTHER_CHARACTERS__) \
+SUFFIX_CHARACTERS_METHOD(__CHARACTERS__) \
+\
 + (NSUInteger) isMatchingSuffix:(const unichar*)string maxLength:(NSUInteger)maxLength { \
     IS_MATCHING_CHARACTERS_EXTENDED(__CHARACTERS__, __WHITESPACE_OR_NEWLINE__, __OTHER_CHARACTERS__, string, maxLength) \
     return _matching; \
@@ -61,6 +98,13 @@
 #define KEYWORD_CLASS_IMPLEMENTATION(__LANGUAGE__, __NAME__, __MATCH__) \
 @implementation ParserNode##__LANGUAGE__##__NAME__ \
 \
+PREFIX_CHARACTERS_METHOD(__MATCH__) \
+\
++ (const ParserNodeKeywordDefinition*) keywordDefinition { \
+    static const ParserNodeKeywordDefinition definition = {#__LANGUAGE__, __MATCH__, NO, NULL}; \
+    return &definition; \
+} \
+\
 + (NSUInteger) isMatchingPrefix:(const unichar*)string maxLength:(NSUInteger)maxLength { \
     if(IsAlphaNumerical(*(string - 1))) \
         return NSNotFound; \
@@ -78,6 +122,12 @@
 #define PREFIX_SUFFIX_CLASS_IMPLEMENTATION(__NAME__, __START__, __END__) \
 @implementation ParserNode##__NAME__ \
 \
+PREFIX_CHARACTERS_METHOD(__START__) \
+\
+SUFFIX_CHARACTERS_METHOD(__END__) \
+\
+TERMINATOR_METHOD(__END__, 0) \
+\
 + (NSUInteger) isMatchingPrefix:(const unichar*)string maxLength:(NSUInteger)maxLength { \
     IS_MATCHING_CHARACTERS(__START__, string, maxLength); \
     return _matching; \
@@ -109,41 +159,133 @@ static inline BOOL _EqualsCharacters(const unichar* string, const char* array, N
     return YES;
 }
 
+extern NSUInteger _kindCount;
+extern NSUInteger _kindMaskWords;
+extern const uint64_t* _kindMasks; //"_kindMaskWords" words per kind with the bits of all the kinds it is a kind of (itself included)
+
+NSUInteger _KindOfClass(Class class); //Returns NSNotFound if "class" is not a node class
+Class _ClassOfKind(NSUInteger kind); //Returns Nil if "kind" is not valid
+void _AddClassToKindMask(Class class, uint64_t* mask); //Adds the kind of "class" to "mask" so that a node is in it if it is a kind of "class"
+
+static inline void _AddKindToMask(NSUInteger kind, uint64_t* mask) {
+    mask[kind / 64] |= 1ULL << (kind % 64);
+}
+
+static inline BOOL _IsKindInMask(NSUInteger kind, const uint64_t* mask) {
+    return (mask[kind / 64] & (1ULL << (kind % 64))) != 0;
+}
+
+static inline BOOL _IsNodeOfKind(ParserNode* node, NSUInteger kind) {
+    return node && _IsKindInMask(kind, &_kindMasks[node->_kind * _kindMaskWords]);
+}
+
+static inline BOOL _IsKindOfAnyKind(NSUInteger kind, const uint64_t* mask) {
+    const uint64_t* kinds = &_kindMasks[kind * _kindMaskWords];
+    for(NSUInteger i = 0; i < _kindMaskWords; ++i) {
+        if(kinds[i] & mask[i]) {
+            return YES;
+        }
+    }
+    return NO;
+}
+
+static inline BOOL _IsNodeOfAnyKind(ParserNode* node, const uint64_t* mask) {
+    return node && _IsKindOfAnyKind(node->_kind, mask);
+}
+
+#define KIND(__NAME__) ({ \
+    static NSUInteger __kind = NSNotFound; \
+    if(__kind == NSNotFound) \
+        __kind = _KindOfClass([ParserNode##__NAME__ class]); \
+    __kind; \
+})
+
+#define IS_KIND(__NODE__, __NAME__) _IsNodeOfKind(__NODE__, KIND(__NAME__)) //Equivalent to -isKindOfClass:
+#define IS_MEMBER_OF_KIND(__NODE__, __NAME__) ({ ParserNode* __node = (__NODE__); __node && (__node->_kind == KIND(__NAME__)); }) //Equivalent to -isMemberOfClass:
+
+#define KIND_MASK(__NAME__) \
+    uint64_t __NAME__[_kindMaskWords]; \
+    bzero(__NAME__, sizeof(__NAME__))
+
+typedef struct ParserArena ParserArena;
+
+ParserArena* _ParserArenaCreate(NSString* text); //Returns an arena with a retain count of 1 - Nodes of "text" allocated from it do not retain it
+void _ParserArenaRelease(ParserArena* arena);
+ParserArena* _ParserArenaSetCurrent(ParserArena* arena); //Nodes other than roots allocated on the calling thread come from "arena" if not NULL - Returns the previous current arena
+NSUInteger _ParserArenaLiveCount(); //Number of arenas not destroyed yet
+
+BOOL _MarkNodeUnmodified(ParserNode* node, NSString* text); //Lets nodes whose content is still "text" in their range use it directly
+void _ShiftNodeTree(ParserNode* node, NSString* text, NSRange editedRange, NSInteger delta, ParserNode* skippedNode); //Moves all nodes but "skippedNode" to "text" after "editedRange" was replaced by "delta" more characters
+
+void _MoveChildren(ParserNode* parent, NSRange range, ParserNode* newParent, NSUInteger index); //Moves the children of "parent" in "range" at once before the child at "index" of "newParent" or removes them if "newParent" is nil
 void _RearrangeNodesAsParentAndChildren(ParserNode* startNode, ParserNode* endNode);
 void _AdoptNodesAsChildren(ParserNode* startNode, ParserNode* endNode);
 NSString* _CleanString(NSString* string, NSArray* nodeClasses);
 NSString* _CleanEscapedString(NSString* string);
 NSString* _StringFromHexUnicodeCharacter(NSString* string);
 
+typedef unichar (*ParserEntityLookupFunction)(const unichar* name, NSUInteger length); //Returns the character for the entity "name" (without '&' and ';') or 0 if there is none
+
+NSString* _StringWithReplacedEntities(NSString* string, ParserEntityLookupFunction lookup); //Decodes named entities with "lookup" and numeric ones - Returns "string" itself if it contains no '&'
+
 @interface ParserNode ()
 + (BOOL) isAtomic;
 + (NSSet*) patchedClasses; //Node classes this node class must always be matched before
++ (NSString*) prefixCharacters; //Characters a prefix match can start with or nil if any (the parser only tries this node class at these characters)
++ (const ParserNodeKeywordDefinition*) keywordDefinition; //Keyword matched by this node class or NULL (lets the parser recognize it with a single hash lookup)
 + (NSUInteger) isMatchingPrefix:(const unichar*)string maxLength:(NSUInteger)maxLength; //"maxLength" is guaranteed to be at least 1
++ (NSString*) suffixCharacters; //Characters a suffix match can start with or nil if any (the parser skips over other characters while this node class is opened)
++ (const ParserNodeTerminator*) terminator; //Suffix of atomic classes described as data or NULL (lets the parser search for it instead of calling +isMatchingSuffix:maxLength: at every character)
 + (NSUInteger) isMatchingSuffix:(const unichar*)string maxLength:(NSUInteger)maxLength; //"maxLength" may be 0 for atomic classes
++ (BOOL) isReparseBoundary; //Nodes of this class always produce a single node of the same class when their text is parsed on its own, so they can be reparsed in isolation after an edit strictly inside them unless a language of the tree disallows it
 @property(nonatomic) NSRange range;
-@property(nonatomic) NSRange lines;
 @property(nonatomic, assign) ParserNode* parent;
-@property(nonatomic, readonly) NSMutableArray* mutableChildren;
 @property(nonatomic) NSUInteger revision;
 @property(nonatomic) void* jsObject;
+@property(nonatomic, readonly, getter=isModified) BOOL modified;
 - (id) initWithText:(NSString*)text range:(NSRange)range;
 - (ParserNode*) replaceWithNodeOfClass:(Class)class preserveChildren:(BOOL)preserveChildren;
 @end
 
 @interface ParserNodeRoot ()
 @property(nonatomic, assign) ParserLanguage* language;
+- (void) buildLineIndexWithTextBuffer:(const unichar*)textBuffer; //"textBuffer" holds the characters of "text" indexed by location
+- (NSRange) linesForRange:(NSRange)range;
 @end
 
+@interface ParserFrozenTree ()
+- (id) _initWithRoot:(ParserNodeRoot*)root;
+@end
+
+typedef ParserNode* (*ParserSyntaxAnalysisFunction)(ParserLanguage* language, ParserNode* node, const unichar* textBuffer, ParserLanguage* topLevelLanguage); //Return a node whose children to process
+
+typedef struct {
+    NSUInteger passIndex;
+    const char* nodeClass; //Name of the node class the function applies to, including its subclasses unless an earlier rule of the same pass applies to them
+    ParserSyntaxAnalysisFunction function;
+} ParserSyntaxAnalysisRule;
+
+typedef struct ParserNodeRecorder ParserNodeRecorder;
+
+ParserNodeRecorder* _ParserNodeRecorderCreate();
+void _ParserNodeRecorderRelease(ParserNodeRecorder* recorder); //Releases all recorded nodes
+ParserNodeRecorder* _ParserNodeRecorderSetCurrent(ParserNodeRecorder* recorder); //Nodes allocated on the calling thread are retained and recorded by "recorder" if not NULL - Returns the previous current recorder
+void _ParserNodeRecorderEndOrderedNodes(ParserNodeRecorder* recorder); //Must be called once the tree is built and before modifying it
+ParserNode** _CopyRecordedNodesInTree(ParserNodeRecorder* recorder, const ParserSyntaxAnalysisFunction* functions, ParserNode* root, NSUInteger* count); //Returns a malloc'ed array of the recorded nodes in the tree of "root" with a function, in depth-first order
+NSUInteger _DepthInTree(ParserNode* node, ParserNode* root, CFSetRef excludedNodes); //Returns NSNotFound if "node" is not in the tree of "root" or is in the subtree of any of "excludedNodes" (may be NULL)
+
 @interface ParserLanguage ()
 + (NSArray*) languageDependencies;
 + (NSSet*) languageReservedKeywords;
 + (NSArray*) languageNodeClasses;
 + (NSUInteger) languageSyntaxAnalysisPasses;
++ (BOOL) languageAllowsReparseBoundary:(Class)nodeClass; //Returns YES by default - Languages whose syntax analysis of nodes of "nodeClass" depends on their ancestors must return NO
++ (const ParserSyntaxAnalysisRule*) languageSyntaxAnalysisRules; //Terminated by a rule with a NULL "nodeClass" - Returns NULL by default in which case -performSyntaxAnalysis:forNode:textBuffer:topLevelLanguage: is called on all nodes instead
 + (ParserNodeRoot*) newNodeTreeFromText:(NSString*)text withNodeClasses:(NSArray*)nodeClasses;
 + (ParserNodeRoot*) newNodeTreeFromText:(NSString*)text range:(NSRange)range textBuffer:(const unichar*)textBuffer withNodeClasses:(NSArray*)nodeClasses;
 @property(nonatomic, readonly) NSArray* allLanguageDependencies;
 - (ParserNodeRoot*) parseText:(NSString*)text range:(NSRange)range textBuffer:(const unichar*)textBuffer syntaxAnalysis:(BOOL)syntaxAnalysis;
-- (ParserNode*) performSyntaxAnalysis:(NSUInteger)passIndex forNode:(ParserNode*)node textBuffer:(const unichar*)textBuffer topLevelLanguage:(ParserLanguage*)topLevelLanguage; //Override point to perform language dependent string tree refactoring after parsing
+- (ParserNode*) performSyntaxAnalysis:(NSUInteger)passIndex forNode:(ParserNode*)node textBuffer:(const unichar*)textBuffer topLevelLanguage:(ParserLanguage*)topLevelLanguage; //Override point to perform language dependent string tree refactoring after parsing for languages without syntax analysis rules
 @end
 
 @protocol ParserLanguageCTopLevelNodeClasses
@@ -154,3 +296,14 @@ NSString* _StringFromHexUnicodeCharacter(NSString* string);
 + (NSString*) stringWithReplacedEntities:(NSString*)string;
 + (Class) SGMLElementClass;
 @end
+
+typedef struct {
+    const char* name; //ASCII
+    const char* nodeClass;
+} ParserElementClassMapping;
+
+typedef struct ParserElementClassTable ParserElementClassTable;
+
+ParserElementClassTable* _ParserElementClassTableCreate(const ParserElementClassMapping* mappings, BOOL caseInsensitive); //"mappings" is terminated by a NULL name - Case-insensitive tables only fold ASCII letters
+void _ParserElementClassTableRelease(ParserElementClassTable* table);
+Class _ElementClassForName(const ParserElementClassTable* table, NSString* name); //Returns Nil if "name" is not in "table"
@@ -17,23 +17,162 @@
 */
 
 #import <libgen.h>
+#import <glob.h>
+#import <pthread.h>
 
 #import "ParserLanguage.h"
+#import "JavaScriptBindings.h"
 
-extern BOOL RunJavaScriptOnRootNode(NSString* script, ParserNode* root);
+typedef struct {
+    NSArray* paths;
+    NSUInteger nextPath;
+    NSUInteger failures;
+    pthread_mutex_t mutex;
+    NSString* script;
+    ParserLanguage* language;
+} BatchQueue;
+
+static void _AddDirectoryFiles(NSMutableArray* files, NSString* directory, ParserLanguage* language) {
+    NSDirectoryEnumerator* enumerator = [[NSFileManager defaultManager] enumeratorAtPath:directory];
+    NSString* path;
+    while((path = [enumerator nextObject])) {
+        if(![[[enumerator fileAttributes] fileType] isEqualToString:NSFileTypeRegular]) {
+            continue;
+        }
+        NSString* extension = [path pathExtension];
+        if([extension isEqualToString:@"gz"]) {
+            extension = [[path stringByDeletingPathExtension] pathExtension];
+        }
+        if(language ? [language.fileExtensions containsObject:[extension lowercaseString]] : ([ParserLanguage defaultLanguageForFileExtension:extension] != nil)) { //Skip files no language can parse
+            [files addObject:[directory stringByAppendingPathComponent:path]];
+        }
+    }
+}
+
+static void _AddInputFiles(NSMutableArray* files, NSString* input, ParserLanguage* language) {
+    NSMutableArray* paths = [NSMutableArray array];
+    if(strpbrk([input UTF8String], "*?[")) {
+        glob_t result;
+        if(glob([input fileSystemRepresentation], 0, NULL, &result) == 0) {
+            for(size_t i = 0; i < result.gl_pathc; ++i) {
+                [paths addObject:[[NSFileManager defaultManager] stringWithFileSystemRepresentation:result.gl_pathv[i] length:strlen(result.gl_pathv[i])]];
+            }
+        } else {
+            printf("No files matching \"%s\"\n", [input UTF8String]);
+        }
+        globfree(&result);
+    } else {
+        [paths addObject:input];
+    }
+    for(NSString* path in paths) {
+        BOOL isDirectory;
+        if([[NSFileManager defaultManager] fileExistsAtPath:path isDirectory:&isDirectory] && isDirectory) {
+            _AddDirectoryFiles(files, path, language);
+        } else {
+            [files addObject:path];
+        }
+    }
+}
+
+static void* _BatchWorker(void* arg) {
+    BatchQueue* queue = (BatchQueue*)arg;
+    NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+    JavaScriptContextRef context = queue->script ? JavaScriptContextCreate(queue->script) : NULL; //Each worker evaluates the script once in its own context
+    while(1) {
+        NSString* path = nil;
+        pthread_mutex_lock(&queue->mutex);
+        if(queue->nextPath < queue->paths.count) {
+            path = [queue->paths objectAtIndex:queue->nextPath++];
+        }
+        pthread_mutex_unlock(&queue->mutex);
+        if(path == nil) {
+            break;
+        }
+        
+        NSAutoreleasePool* localPool = [[NSAutoreleasePool alloc] init];
+        const char* error = NULL;
+        ParserNodeRoot* root = [ParserLanguage parseTextFile:path language:queue->language encoding:NSUTF8StringEncoding syntaxAnalysis:YES];
+        if(root == nil) {
+            error = "parsing failed";
+        } else if(queue->script) {
+            if(context == NULL) {
+                error = "invalid JavaScript";
+            } else if([[path pathExtension] isEqualToString:@"gz"]) {
+                error = "cannot rewrite compressed files";
+            } else if(!JavaScriptContextRunOnRootNode(context, root)) {
+                error = "JavaScript failed";
+            } else if(![root.content isEqualToString:root.text] && ![root writeContentToFile:path encoding:NSUTF8StringEncoding]) { //Leave files the script did not change untouched
+                error = "writing failed";
+            }
+        }
+        pthread_mutex_lock(&queue->mutex);
+        if(error) {
+            printf("FAILED %s (%s)\n", [path UTF8String], error);
+            queue->failures += 1;
+        } else {
+            printf("ok     %s\n", [path UTF8String]);
+        }
+        pthread_mutex_unlock(&queue->mutex);
+        [localPool drain];
+    }
+    JavaScriptContextRelease(context);
+    [pool drain];
+    return NULL;
+}
+
+/* Files are parsed and rewritten in place by "script" on "jobs" threads, and reported one per line in completion order */
+static BOOL _RunBatch(NSArray* paths, ParserLanguage* language, NSString* script, NSUInteger jobs) {
+    BatchQueue queue;
+    queue.paths = paths;
+    queue.nextPath = 0;
+    queue.failures = 0;
+    pthread_mutex_init(&queue.mutex, NULL);
+    queue.script = script;
+    queue.language = language;
+    
+    for(ParserLanguage* batchLanguage in [ParserLanguage allLanguages]) { //Make sure languages and their lazily computed state are ready before spawning threads
+        [batchLanguage reservedKeywords]; //Also computes the language dependencies
+        [batchLanguage nodeClasses];
+    }
+    if(script) {
+        JavaScriptContextRelease(JavaScriptContextCreate(script)); //Also reports JavaScript evaluation errors only once
+    }
+    
+    jobs = MAX(MIN(jobs, paths.count), 1);
+    pthread_t* threads = malloc(jobs * sizeof(pthread_t));
+    for(NSUInteger i = 1; i < jobs; ++i) {
+        if(pthread_create(&threads[i], NULL, _BatchWorker, &queue)) {
+            jobs = i;
+            break;
+        }
+    }
+    _BatchWorker(&queue);
+    for(NSUInteger i = 1; i < jobs; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    
+    pthread_mutex_destroy(&queue.mutex);
+    printf("%i file(s) processed, %i failure(s)\n", (int)paths.count, (int)queue.failures);
+    return (queue.failures == 0);
+}
 
 int main(int argc, const char* argv[]) {
     NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
     int result = 1;
     NSString* optionScript = nil;
+    ParserLanguage* optionLanguage = nil;
     BOOL nodesOption = NO;
     BOOL compactOption = NO;
     BOOL detailedOption = NO;
+    NSUInteger optionJobs = 1;
+    NSMutableArray* inputs = [NSMutableArray array];
+    BOOL batchMode = NO;
     NSString* inFile = nil;
     
     if(argc >= 2) {
         int offset = 1;
-        while(argv[offset][0] == '-') {
+        while((argv[offset][0] == '-') && argv[offset][1]) { //A single "-" means stdin
             if(strcmp(argv[offset], "--nodes") == 0) {
                 nodesOption = YES;
             } else if(strcmp(argv[offset], "--compact") == 0) {
@@ -51,22 +190,80 @@ int main(int argc, const char* argv[]) {
                         goto Exit;
                     }
                 }
+            } else if((strcmp(argv[offset], "-language") == 0) && (offset + 1 < argc)) {
+                optionLanguage = [ParserLanguage languageWithName:[NSString stringWithUTF8String:argv[offset + 1]]];
+                if(optionLanguage) {
+                    ++offset;
+                } else {
+                    printf("Unknown language \"%s\"\n", argv[offset + 1]);
+                    goto Exit;
+                }
+            } else if((strcmp(argv[offset], "-j") == 0) && (offset + 1 < argc)) {
+                optionJobs = MAX(atoi(argv[offset + 1]), 1);
+                batchMode = YES;
+                ++offset;
+            } else if((strcmp(argv[offset], "-list") == 0) && (offset + 1 < argc)) {
+                NSString* path = [[NSString stringWithUTF8String:argv[offset + 1]] stringByStandardizingPath];
+                NSString* list = [NSString stringWithContentsOfFile:path encoding:NSUTF8StringEncoding error:NULL];
+                if(list) {
+                    for(NSString* line in [list componentsSeparatedByCharactersInSet:[NSCharacterSet newlineCharacterSet]]) {
+                        line = [line stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+                        if(line.length) {
+                            [inputs addObject:[line stringByStandardizingPath]];
+                        }
+                    }
+                    batchMode = YES;
+                    ++offset;
+                } else {
+                    printf("Failed loading file list from \"%s\"\n", [path UTF8String]);
+                    goto Exit;
+                }
             }
             ++offset;
             if(offset >= argc) {
                 break;
             }
         }
-        if(offset < argc) {
-            inFile = [[NSString stringWithUTF8String:argv[offset]] stringByStandardizingPath];
+        for(; offset < argc; ++offset) {
+            [inputs addObject:[[NSString stringWithUTF8String:argv[offset]] stringByStandardizingPath]];
+        }
+    }
+    if(inputs.count == 1) {
+        BOOL isDirectory;
+        inFile = [inputs objectAtIndex:0];
+        if(strpbrk([inFile UTF8String], "*?[") || ([[NSFileManager defaultManager] fileExistsAtPath:inFile isDirectory:&isDirectory] && isDirectory)) {
+            batchMode = YES;
         }
+    } else if(inputs.count > 1) {
+        batchMode = YES;
+    }
+    if(inputs.count == 0) {
+        printf("%s [--nodes] [--compact | --detailed] [-script JavaScriptFilePath] [-language LanguageName] inFile | inFile.gz | -\n", basename((char*)argv[0]));
+        printf("%s [-script JavaScriptFilePath] [-language LanguageName] [-j Jobs] [-list FileListPath] [inFile | directory | glob ...]\n", basename((char*)argv[0]));
+        goto Exit;
     }
-    if(inFile == nil) {
-        printf("%s [--nodes] [--compact | --detailed] [-script JavaScriptFilePath] inFile\n", basename((char*)argv[0]));
+    
+    if(batchMode) {
+        NSMutableArray* files = [NSMutableArray array];
+        for(NSString* input in inputs) {
+            _AddInputFiles(files, input, optionLanguage);
+        }
+        NSMutableArray* uniqueFiles = [NSMutableArray arrayWithCapacity:files.count];
+        NSMutableSet* addedFiles = [NSMutableSet setWithCapacity:files.count];
+        for(NSString* path in files) { //Overlapping inputs must not have several workers rewrite the same file at once
+            path = [path stringByStandardizingPath];
+            if(![addedFiles containsObject:path]) {
+                [addedFiles addObject:path];
+                [uniqueFiles addObject:path];
+            }
+        }
+        if(_RunBatch(uniqueFiles, optionLanguage, optionScript, optionJobs)) {
+            result = 0;
+        }
         goto Exit;
     }
     
-    ParserNodeRoot* root = [ParserLanguage parseTextFile:inFile encoding:NSUTF8StringEncoding syntaxAnalysis:YES];
+    ParserNodeRoot* root = [ParserLanguage parseTextFile:inFile language:optionLanguage encoding:NSUTF8StringEncoding syntaxAnalysis:YES];
     if(root) {
         if(nodesOption) {
             printf("%s\n", [[root.language.nodeClasses description] UTF8String]);
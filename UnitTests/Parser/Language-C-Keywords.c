@@ -0,0 +1,9 @@
+int iffy = returned ? intern : if_else;
+
+<----->
+
+<Root>
+·  ♢|int|♢•♢iffy♢•♢=♢•♢
+·  <CConditionalOperator>
+·  ·  ♢returned♢•♢|?|♢•♢intern♢•♢|:|♢•♢if_else♢
+·  ♢|;|♢¶♢¶♢
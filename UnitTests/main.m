@@ -18,6 +18,7 @@
 
 #import "ParserLanguage.h"
 #import "JavaScriptBindings.h"
+#import "Parser_Internal.h"
 
 static BOOL _ValidateResult(NSString* name, NSString* actualResult, NSString* expectedResult) {
     if(!actualResult) {
@@ -49,10 +50,88 @@ static BOOL _ValidateResult(NSString* name, NSString* actualResult, NSString* ex
     return YES;
 }
 
+typedef struct {
+    NSMutableString* content;
+    NSInteger depth;
+} EventContext;
+
+static BOOL _EventFunction(const ParserEvent* event, void* context) {
+    EventContext* eventContext = (EventContext*)context;
+    switch(event->type) {
+        case kParserEventType_Open: ++eventContext->depth; break;
+        case kParserEventType_Close: --eventContext->depth; break;
+        case kParserEventType_Leaf: CFStringAppendCharacters((CFMutableStringRef)eventContext->content, event->characters + event->range.location, event->range.length); break;
+    }
+    return eventContext->depth >= 0;
+}
+
+static ParserNode* _FindLargestParent(ParserNode* node) {
+    ParserNode* largest = node;
+    for(ParserNode* child in node.children) {
+        if(child.children) {
+            child = _FindLargestParent(child);
+            if(child.children.count > largest.children.count) {
+                largest = child;
+            }
+        }
+    }
+    return largest;
+}
+
+//Parses texts made of a growing number of siblings then walks them - Times should grow linearly
+static void _RunBenchmark(NSString* languageName, NSString* prefix, NSString* sibling, NSString* separator, NSString* suffix) {
+    ParserLanguage* language = [ParserLanguage languageWithName:languageName];
+    for(NSUInteger count = 25000; count <= 100000; count *= 2) {
+        NSAutoreleasePool* localPool = [[NSAutoreleasePool alloc] init];
+        NSMutableString* string = [NSMutableString stringWithString:prefix];
+        for(NSUInteger i = 0; i < count; ++i) {
+            if(i) {
+                [string appendString:separator];
+            }
+            [string appendFormat:sibling, (int)i];
+        }
+        [string appendString:suffix];
+        
+        CFAbsoluteTime time = CFAbsoluteTimeGetCurrent();
+        ParserNodeRoot* root = [language parseText:string syntaxAnalysis:YES];
+        CFAbsoluteTime parseTime = CFAbsoluteTimeGetCurrent() - time;
+        
+        time = CFAbsoluteTimeGetCurrent();
+        ParserNode* parent = _FindLargestParent(root);
+        NSUInteger siblings = 0;
+        for(ParserNode* node = parent.firstChild; node; node = node.nextSibling) {
+            if([parent indexOfChild:node] != siblings) {
+                NSLog(@"<INVALID CHILD INDEX IN %@ BENCHMARK>", languageName);
+                break;
+            }
+            ++siblings;
+        }
+        for(ParserNode* node = parent.lastChild; node; node = node.previousSibling) {
+            --siblings;
+        }
+        CFAbsoluteTime walkTime = CFAbsoluteTimeGetCurrent() - time;
+        
+        time = CFAbsoluteTimeGetCurrent();
+        Class class = [parent.lastChild class];
+        for(ParserNode* node = parent.firstChild; node != parent.lastChild; node = node.nextSibling) {
+            ParserNode* sibling = [node findNextSiblingOfClass:class];
+            if(![sibling isKindOfClass:class] || ([parent indexOfChild:sibling] <= [parent indexOfChild:node])) {
+                NSLog(@"<INVALID SIBLING SEARCH IN %@ BENCHMARK>", languageName);
+                break;
+            }
+        }
+        CFAbsoluteTime searchTime = CFAbsoluteTimeGetCurrent() - time;
+        
+        printf("%s benchmark: %i siblings parsed in %.0f ms, walked in %.0f ms and searched in %.0f ms\n", [languageName UTF8String], (int)parent.children.count, parseTime * 1000.0, walkTime * 1000.0, searchTime * 1000.0);
+        [localPool drain];
+    }
+}
+
 int main(int argc, const char* argv[]) {
     NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
     BOOL skipParser = NO;
     BOOL skipBindings = NO;
+    BOOL runBenchmarks = NO;
     NSString* basePath;
     
     NSMutableSet* filteredFiles = [NSMutableSet set];
@@ -62,6 +141,8 @@ int main(int argc, const char* argv[]) {
                 skipParser = YES;
             } else if(strcmp(argv[i], "--skipBindings") == 0) {
                 skipBindings = YES;
+            } else if(strcmp(argv[i], "--benchmark") == 0) {
+                runBenchmarks = YES;
             }
         } else {
             [filteredFiles addObject:[NSString stringWithUTF8String:argv[i]]];
@@ -115,6 +196,53 @@ int main(int argc, const char* argv[]) {
                                 if(!_ValidateResult([NSString stringWithFormat:@"%@-Detailed", [path lastPathComponent]], root.detailedDescription, expected))
                                     success = NO;
                             }
+                            NSUInteger liveArenas = _ParserArenaLiveCount();
+                            NSAutoreleasePool* arenaPool = [[NSAutoreleasePool alloc] init];
+                            [ParserLanguage setUsesArenaAllocation:YES];
+                            ParserNodeRoot* arenaRoot = [language parseText:string syntaxAnalysis:YES];
+                            [ParserLanguage setUsesArenaAllocation:NO];
+                            if(!_ValidateResult([NSString stringWithFormat:@"%@-Arena", [path lastPathComponent]], arenaRoot.detailedDescription, root.detailedDescription)) {
+                                success = NO;
+                            }
+                            [arenaPool drain];
+                            if(_ParserArenaLiveCount() != liveArenas) {
+                                NSLog(@"<FAILED DESTROYING ARENA FROM \"%@\">", path);
+                                success = NO;
+                            }
+                            ParserFrozenTree* frozenTree = [root freeze];
+                            if(!_ValidateResult([NSString stringWithFormat:@"%@-Frozen", [path lastPathComponent]], [frozenTree nodeAtIndex:0].detailedDescription, root.detailedDescription)) {
+                                success = NO;
+                            }
+                            EventContext context = {[NSMutableString string], 0};
+                            if(![language parseText:string withEventFunction:_EventFunction context:&context] || context.depth) {
+                                NSLog(@"<FAILED PARSING EVENTS FROM \"%@\">", path);
+                                success = NO;
+                            } else if(!_ValidateResult([NSString stringWithFormat:@"%@-Events", [path lastPathComponent]], context.content, string)) {
+                                success = NO;
+                            }
+                            NSString* eventPath = [NSTemporaryDirectory() stringByAppendingPathComponent:[path lastPathComponent]];
+                            EventContext fileContext = {[NSMutableString string], 0};
+                            if(![string writeToFile:eventPath atomically:YES encoding:NSUTF8StringEncoding error:NULL] || ![ParserLanguage parseTextFile:eventPath language:language encoding:NSUTF8StringEncoding withEventFunction:_EventFunction context:&fileContext] || fileContext.depth) {
+                                NSLog(@"<FAILED PARSING EVENTS FROM FILE \"%@\">", path);
+                                success = NO;
+                            } else if(!_ValidateResult([NSString stringWithFormat:@"%@-FileEvents", [path lastPathComponent]], fileContext.content, string)) {
+                                success = NO;
+                            }
+                            [[NSFileManager defaultManager] removeItemAtPath:eventPath error:NULL];
+                            if(string.length > 1) {
+                                NSRange ranges[] = {{string.length / 2, 1}, {string.length / 2, 0}, {string.length / 3, 0}, {string.length / 4, 1}};
+                                NSString* replacements[] = {@"", @"\"", @"</a>x", @" {[("};
+                                for(NSUInteger i = 0; i < sizeof(ranges) / sizeof(NSRange); ++i) {
+                                    ParserNodeRoot* editedRoot = [language parseText:string syntaxAnalysis:YES];
+                                    NSString* editedString = [string stringByReplacingCharactersInRange:ranges[i] withString:replacements[i]];
+                                    if(![editedRoot reparseWithEditedRange:ranges[i] replacementText:replacements[i]]) {
+                                        NSLog(@"<FAILED REPARSING SOURCE FROM \"%@\">", path);
+                                        success = NO;
+                                    } else if(!_ValidateResult([NSString stringWithFormat:@"%@-Reparse-%i", [path lastPathComponent], (int)i], editedRoot.detailedDescription, [language parseText:editedString syntaxAnalysis:YES].detailedDescription)) {
+                                        success = NO;
+                                    }
+                                }
+                            }
                             if(success)
                                 printf("%s: ok\n", [path UTF8String]);
                             else
@@ -195,6 +323,12 @@ int main(int argc, const char* argv[]) {
         }
     }
     
+    if(runBenchmarks) {
+        _RunBenchmark(@"JSON", @"[", @"%i", @", ", @"]");
+        _RunBenchmark(@"C", @"", @"int value%i = 0;", @"\n", @"\n");
+        _RunBenchmark(@"HTML", @"<html><body>", @"<p>Paragraph %i<br>", @"\n", @"</body></html>");
+    }
+    
     [pool drain];
     return 0;
 }